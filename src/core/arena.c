@@ -38,6 +38,29 @@ void clear_arena(Arena *arena) {
     release_spinlock(&arena->lock);
 }
 
+usize shrink_arena(Arena *arena) {
+    acquire_spinlock(&arena->lock);
+
+    usize num_freed = 0;
+    ListNode *current = arena->pages ? &arena->pages->list : NULL;
+    for (usize i = arena->num_pages; i > 0; i--) {
+        ListNode *next = current->next;
+        ArenaPage *page = container_of(current, ArenaPage, list);
+        if (page->count == 0) {
+            ListNode *rest = detach_from_list(current);
+            if (arena->pages == page)
+                arena->pages = rest ? container_of(next, ArenaPage, list) : NULL;
+            arena->allocator.free(page);
+            arena->num_pages--;
+            num_freed++;
+        }
+        current = next;
+    }
+
+    release_spinlock(&arena->lock);
+    return num_freed;
+}
+
 static void init_arena_page(Arena *arena, ArenaPage *page) {
     page->arena = arena;
     init_list_node(&page->list);
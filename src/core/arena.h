@@ -45,6 +45,10 @@ void init_arena(Arena *arena, usize object_size, ArenaPageAllocator allocator);
 // it will be freed as well.
 void clear_arena(Arena *arena);
 
+// give the pages without allocated objects back to the page allocator.
+// return the number of pages freed.
+usize shrink_arena(Arena *arena);
+
 // NOTE: allocated object memory is uninitialized.
 void *alloc_object(Arena *arena);
 
@@ -99,10 +99,12 @@ int execve(const char* path, char* const argv[], char* const envp[]) {
     if (envp) {
     }
     OpContext ctx;
-    bcache.begin_op(&ctx);
+    bcache.begin_read_op(&ctx);
     Inode* ip = namei(path, &ctx);
-    if (!ip)
+    if (!ip) {
+        bcache.end_op(&ctx);
         return -1;
+    }
     inodes.lock(ip);
 
     // for (int i = 0; i < 12; i++) {
@@ -231,6 +233,7 @@ bad:
     if (ip) {
         inodes.unlock(ip);
         inodes.put(&ctx, ip);
+        bcache.end_op(&ctx);
     }
     /*
      * Step1: Load data from the file stored in `path`.
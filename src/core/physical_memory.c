@@ -6,6 +6,11 @@
 extern char end[];
 PMemory pmem; /* TO-DO: Lab4 multicore: Add locks where needed */
 FreeListNode head;
+static usize num_free_pages; /* protected by `pmem.lock`, read without it. */
+
+static SpinLock hooks_lock;
+static ReclaimHook hooks[MAX_RECLAIM_HOOKS];
+static usize num_hooks;
 /*
  * Editable, as long as it works as a memory manager.
  */
@@ -23,6 +28,7 @@ static void* freelist_alloc(void* datastructure_ptr) {
     /* TO-DO: Lab2 memory*/
     if (f) {
         ((FreeListNode*)(pmem.struct_ptr))->next = f->next;
+        __atomic_store_n(&num_free_pages, num_free_pages - 1, __ATOMIC_RELAXED);
         for (int i = 0; i < PAGE_SIZE; i++)
             ((char*)f)[i] = 0;
     }
@@ -44,6 +50,7 @@ static void freelist_free(void* datastructure_ptr, void* page_address) {
     FreeListNode* p = (FreeListNode*)page_address;
     p->next = f->next;
     f->next = p;
+    __atomic_store_n(&num_free_pages, num_free_pages + 1, __ATOMIC_RELAXED);
 }
 
 /*
@@ -83,6 +90,7 @@ void init_memory_manager(void) {
     init_PMemory(&pmem);
     pmem.page_init(pmem.struct_ptr, ROUNDUP_end, (void*)P2K(phystop));
     init_spinlock(&pmem.lock, "pmem");
+    init_spinlock(&hooks_lock, "reclaim hooks");
 }
 
 /*
@@ -93,6 +101,18 @@ void free_range(void* start, void* end) {
         pmem.page_free(pmem.struct_ptr, p);
 }
 
+/*
+ * Ask the reclaim hooks for `num_pages` pages, in the order they are added.
+ * Returns the number of pages freed.
+ */
+static usize reclaim(usize num_pages) {
+    usize num_freed = 0;
+    usize n = __atomic_load_n(&num_hooks, __ATOMIC_ACQUIRE);
+    for (usize i = 0; i < n && num_freed < num_pages; i++)
+        num_freed += hooks[i](num_pages - num_freed);
+    return num_freed;
+}
+
 /*
  * Allocate a page of physical memory.
  * Returns 0 if failed else a pointer.
@@ -102,6 +122,11 @@ void* kalloc(void) {
     acquire_spinlock(&pmem.lock);
     void* p = pmem.page_alloc(pmem.struct_ptr);
     release_spinlock(&pmem.lock);
+    if (!p && reclaim(1) > 0) {
+        acquire_spinlock(&pmem.lock);
+        p = pmem.page_alloc(pmem.struct_ptr);
+        release_spinlock(&pmem.lock);
+    }
     return p;
 }
 
@@ -111,3 +136,21 @@ void kfree(void* page_address) {
     pmem.page_free(pmem.struct_ptr, page_address);
     release_spinlock(&pmem.lock);
 }
+
+usize get_num_free_pages(void) {
+    return __atomic_load_n(&num_free_pages, __ATOMIC_RELAXED);
+}
+
+void register_reclaim_hook(ReclaimHook hook) {
+    acquire_spinlock(&hooks_lock);
+    usize i = 0;
+    while (i < num_hooks && hooks[i] != hook)
+        i++;
+    if (i == num_hooks) {
+        if (num_hooks == MAX_RECLAIM_HOOKS)
+            PANIC("too many reclaim hooks");
+        hooks[num_hooks] = hook;
+        __atomic_store_n(&num_hooks, num_hooks + 1, __ATOMIC_RELEASE);
+    }
+    release_spinlock(&hooks_lock);
+}
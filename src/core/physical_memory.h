@@ -17,9 +17,25 @@ typedef struct {
     void *next;
 } FreeListNode;
 
+// a reclaim hook gives back memory that can be rebuilt, e.g. cached disk
+// blocks, when `kalloc` runs out of pages. It is asked for `num_pages` pages
+// and returns the number of pages it freed with `kfree`.
+// NOTE: it may run in the middle of any `kalloc` caller, so it must skip
+// whatever that caller may have locked rather than wait for it.
+typedef usize (*ReclaimHook)(usize num_pages);
+
+#define MAX_RECLAIM_HOOKS 4
+
 void init_memory_manager(void);
 void free_range(void *start, void *end);
 void *kalloc(void);
 void kfree(void *page_address);
 
+// get the number of pages `kalloc` can return without reclaiming memory.
+usize get_num_free_pages(void);
+
+// add `hook` to the hooks `kalloc` calls before it fails. Adding the same
+// hook again does nothing.
+void register_reclaim_hook(ReclaimHook hook);
+
 #endif
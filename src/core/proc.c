@@ -103,7 +103,7 @@ void spawn_init_process() {
 
     initproc = p;
     OpContext ctx;
-    bcache.begin_op(&ctx);
+    bcache.begin_read_op(&ctx);
     p->cwd = namei("/", &ctx);
     bcache.end_op(&ctx);
 }
@@ -135,6 +135,35 @@ void spawn_init_process_sd() {
     p->sz = PGSIZE;
 }
 
+/*
+ * A kernel thread will first swtch here, and never returns to user space.
+ */
+static void kernel_thread_enter() {
+    release_sched_lock();
+    thiscpu()->proc->kentry();
+    PANIC("kernel thread returned");
+}
+
+/*
+ * Set up a process that runs `entry` in the kernel.
+ * It has an empty page table, so it should never touch user memory.
+ */
+void spawn_kernel_thread(const char *name, void (*entry)()) {
+    struct proc *p = alloc_proc();
+    if (p == 0) {
+        PANIC("failed alloc proc");
+    }
+    void *newpgdir = pgdir_init();
+    if (newpgdir == 0) {
+        PANIC("failed to alloc pgdir");
+    }
+    p->pgdir = newpgdir;
+    strncpy(p->name, name, sizeof(p->name));
+    p->kentry = entry;
+    p->context->r30 = (u64)kernel_thread_enter;
+    p->state = RUNNABLE;
+}
+
 /*
  * A fork child will first swtch here, and then "return" to user space.
  */
@@ -151,6 +180,8 @@ void forkret() {
         // sd_test();
         //  sd_test();
         init_filesystem();
+        spawn_kernel_thread("bcommit", bcache_committer);
+        spawn_kernel_thread("bread", bcache_reader);
         printf("spawn init\n");
         spawn_init_process();
 
@@ -205,7 +236,7 @@ NO_RETURN void exit() {
         }
     }
     OpContext ctx;
-    bcache.begin_op(&ctx);
+    bcache.begin_read_op(&ctx);
     inodes.put(&ctx, p->cwd);
     bcache.end_op(&ctx);
     p->cwd = 0;
@@ -55,11 +55,13 @@ struct proc {
     struct file* ofile[NOFILE]; /* Open files */
     Inode* cwd;                 /* Current directory */
     u64 stksz, base;
+    void (*kentry)(); /* Entry of a kernel thread, or NULL */
 };
 typedef struct proc proc;
 void init_proc();
 void spawn_init_process();
 void spawn_init_process_sd();
+void spawn_kernel_thread(const char* name, void (*entry)());
 void yield();
 NO_RETURN void exit();
 void sleep(void* chan, SpinLock* lock);
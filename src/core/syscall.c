@@ -53,6 +53,9 @@ const int (*syscall_table[NR_SYSCALL])() = {
     [SYS_read] = (const int*)sys_read,
     [SYS_write] = sys_write,
     [SYS_close] = sys_close,
+    [SYS_fsync] = sys_fsync,
+    [SYS_sync] = sys_sync,
+    [SYS_cachestat] = sys_cachestat,
     [SYS_myyield] = sys_yield};
 
 const char(*syscall_table_str[NR_SYSCALL]) = {
@@ -79,6 +82,9 @@ const char(*syscall_table_str[NR_SYSCALL]) = {
     [SYS_read] = "sys_read",
     [SYS_write] = "sys_write",
     [SYS_close] = "sys_close",
+    [SYS_fsync] = "sys_fsync",
+    [SYS_sync] = "sys_sync",
+    [SYS_cachestat] = "sys_cachestat",
     [SYS_myyield] = "sys_yield"};
 
 u64 syscall_dispatch(Trapframe* frame) {
@@ -18,6 +18,9 @@ isize sys_read();
 isize sys_write();
 isize sys_writev();
 int sys_close();
+int sys_fsync();
+int sys_sync();
+int sys_cachestat();
 int sys_fstat();
 int sys_fstatat();
 Inode* create(char* path, short type, short major, short minor, OpContext* ctx);
@@ -4,3 +4,4 @@
 #define SYS_myexit   457
 #define SYS_myprint  458
 #define SYS_myyield  459
+#define SYS_cachestat 460
@@ -138,6 +138,33 @@ int sys_close() {
     return 0;
 }
 
+/*
+ * Wait until all finished writes are on disk.
+ * The log commits whole transactions, so this is no cheaper than `sync`.
+ */
+int sys_fsync() {
+    if (argfd(0, 0, 0) < 0)
+        return -1;
+    bcache.barrier();
+    return 0;
+}
+
+int sys_sync() {
+    bcache.barrier();
+    return 0;
+}
+
+/*
+ * Copy the counters of the block cache to the user, see `CacheStats`.
+ */
+int sys_cachestat() {
+    CacheStats* st;
+    if (argptr(0, (void*)&st, sizeof(*st)) < 0)
+        return -1;
+    bcache.get_cache_stats(st);
+    return 0;
+}
+
 /*
  * Get the parameters and call filestat.
  */
@@ -170,7 +197,7 @@ int sys_fstatat() {
 
     Inode* ip;
     OpContext ctx;
-    bcache.begin_op(&ctx);
+    bcache.begin_read_op(&ctx);
     if ((ip = namei(path, &ctx)) == 0) {
         bcache.end_op(&ctx);
         return -1;
@@ -266,7 +293,10 @@ int sys_openat() {
     // }
 
     OpContext ctx;
-    bcache.begin_op(&ctx);
+    if (omode & O_CREAT)
+        bcache.begin_op_sized(&ctx, OP_RESERVE_CREATE);
+    else
+        bcache.begin_read_op(&ctx);
     if (omode & O_CREAT) {
         // FIXME: Support acl mode.
         ip = create(path, INODE_REGULAR, 0, 0, &ctx);
@@ -325,7 +355,7 @@ int sys_mkdirat() {
         return -1;
     }
     OpContext ctx;
-    bcache.begin_op(&ctx);
+    bcache.begin_op_sized(&ctx, OP_RESERVE_CREATE);
     if ((ip = create(path, INODE_DIRECTORY, 0, 0, &ctx)) == 0) {
         bcache.end_op(&ctx);
         return -1;
@@ -353,7 +383,7 @@ int sys_mknodat() {
     printf("mknodat: path '%s', major:minor %d:%d\n", path, major, minor);
 
     OpContext ctx;
-    bcache.begin_op(&ctx);
+    bcache.begin_op_sized(&ctx, OP_RESERVE_CREATE);
     if ((ip = create(path, INODE_DEVICE, major, minor, &ctx)) == 0) {
         bcache.end_op(&ctx);
         return -1;
@@ -371,7 +401,7 @@ int sys_chdir() {
     struct proc* curproc = thiscpu()->proc;
 
     OpContext ctx;
-    bcache.begin_op(&ctx);
+    bcache.begin_read_op(&ctx);
     if (argstr(0, &path) < 0 || (ip = namei(path, &ctx)) == 0) {
         bcache.end_op(&ctx);
         return -1;
@@ -12,7 +12,14 @@
 struct buf {
     int flags;
     u32 blockno;
-    u8 data[BSIZE];  // 1B*512
+    u8 *data;  // caller-owned buffer of BSIZE bytes, which must be word-aligned.
+
+    // a request may cover `count` consecutive blocks from `blockno`, the i-th
+    // of which is transferred to/from `vec[i]`. `vec` == NULL means a single
+    // block in `data`, and `count` of 0 is taken as 1.
+    u32 count;
+    u8 **vec;
+    u32 done;  // number of blocks transferred so far.
 
     /*
      * Add other necessary elements. It depends on you.
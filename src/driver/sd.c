@@ -259,12 +259,20 @@ static EMMCCommand sdCommandTable[] = {
     {"GO_INACTIVE", 0x0F000000 | CMD_RSPNS_NO, RESP_NO, RCA_YES, 0},
     {"SET_BLOCKLEN", 0x10000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"READ_SINGLE", 0x11000000 | CMD_RSPNS_48 | CMD_IS_DATA | TM_DAT_DIR_CH, RESP_R1, RCA_NO, 0},
-    {"READ_MULTI", 0x12000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_DAT_DIR_CH, RESP_R1, RCA_NO, 0},
+    {"READ_MULTI",
+     0x12000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_AUTO_CMD12 | TM_DAT_DIR_CH,
+     RESP_R1,
+     RCA_NO,
+     0},
     {"SEND_TUNING", 0x13000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"SPEED_CLASS", 0x14000000 | CMD_RSPNS_48B, RESP_R1b, RCA_NO, 0},
     {"SET_BLOCKCNT", 0x17000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"WRITE_SINGLE", 0x18000000 | CMD_RSPNS_48 | CMD_IS_DATA | TM_DAT_DIR_HC, RESP_R1, RCA_NO, 0},
-    {"WRITE_MULTI", 0x19000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_DAT_DIR_HC, RESP_R1, RCA_NO, 0},
+    {"WRITE_MULTI",
+     0x19000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_AUTO_CMD12 | TM_DAT_DIR_HC,
+     RESP_R1,
+     RCA_NO,
+     0},
     {"PROGRAM_CSD", 0x1B000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"SET_WRITE_PR", 0x1C000000 | CMD_RSPNS_48B, RESP_R1b, RCA_NO, 0},
     {"CLR_WRITE_PR", 0x1D000000 | CMD_RSPNS_48B, RESP_R1b, RCA_NO, 0},
@@ -505,6 +513,7 @@ struct SpinLock sdlock;
 struct SpinLock qlock;
 struct bufQueue sdque;
 struct buf mbr;
+static u32 mbr_data[BSIZE / 4];
 
 u32 lba2, sz2;
 
@@ -526,6 +535,7 @@ void sd_init() {
      * sdWaitForInterrupt for clearing certain interrupt.
      */
 
+    mbr.data = (u8 *)mbr_data;
     sd_start(&mbr);
     sdWaitForInterrupt(INT_READ_RDY);
     int done = 0;
@@ -548,6 +558,16 @@ static void sd_delayus(u32 c) {
     delayus(c * 3);
 }
 
+/* Number of blocks covered by b. */
+static u32 buf_count(struct buf *b) {
+    return b->count ? b->count : 1;
+}
+
+/* Buffer of the i-th block of b. */
+static u32 *buf_data(struct buf *b, u32 i) {
+    return (u32 *)(b->vec ? b->vec[i] : b->data);
+}
+
 /* Start the request for b. Caller must hold sdlock. */
 static void sd_start(struct buf *b) {
     // Address is different depending on the card type.
@@ -565,28 +585,39 @@ static void sd_start(struct buf *b) {
     disb();
 
     // Work out the status, interrupt and command values for the transfer.
-    int cmd = write ? IX_WRITE_SINGLE : IX_READ_SINGLE;
+    // Multi-block commands stop by auto CMD12 after `count` blocks.
+    u32 count = buf_count(b);
+    int cmd;
+    if (count > 1)
+        cmd = write ? IX_WRITE_MULTI : IX_READ_MULTI;
+    else
+        cmd = write ? IX_WRITE_SINGLE : IX_READ_SINGLE;
 
     int resp;
-    *EMMC_BLKSIZECNT = 512;
+    *EMMC_BLKSIZECNT = (count << 16) | 512;
+    b->done = 0;
+
+    for (u32 i = 0; i < count; i++)
+        asserts((((i64)buf_data(b, i)) & 0x03) == 0, "Only support word-aligned buffers. ");
 
     if ((resp = sdSendCommandA(cmd, bno))) {
         PANIC("* EMMC send command error.");
     }
 
-    int done = 0;
-    u32 *intbuf = (u32 *)b->data;
-    asserts((((i64)b->data) & 0x03) == 0, "Only support word-aligned buffers. ");
-
     if (write) {
-        // Wait for ready interrupt for the next block.
-        if ((resp = sdWaitForInterrupt(INT_WRITE_RDY))) {
-            PANIC("* EMMC ERROR: Timeout waiting for ready to write\n");
-            // return sdDebugResponse(resp);
+        for (u32 i = 0; i < count; i++) {
+            int done = 0;
+            u32 *intbuf = buf_data(b, i);
+            // Wait for ready interrupt for the next block.
+            if ((resp = sdWaitForInterrupt(INT_WRITE_RDY))) {
+                PANIC("* EMMC ERROR: Timeout waiting for ready to write\n");
+                // return sdDebugResponse(resp);
+            }
+            asserts(!*EMMC_INTERRUPT, "%d ", *EMMC_INTERRUPT);
+            while (done < 128)
+                *EMMC_DATA = intbuf[done++];
         }
-        asserts(!*EMMC_INTERRUPT, "%d ", *EMMC_INTERRUPT);
-        while (done < 128)
-            *EMMC_DATA = intbuf[done++];
+        b->done = count;
     }
 }
 
@@ -627,10 +658,15 @@ void sd_intr() {
             PANIC(",,,");
         }
         if (!is_write) {
+            // One INT_READ_RDY for each block of a multi-block read.
             int done = 0;
-            u32 *ip = (u32 *)bid->data;
+            u32 *ip = buf_data(bid, bid->done++);
             while (done < 128)
                 ip[done++] = *EMMC_DATA;
+            if (bid->done < buf_count(bid)) {
+                release_spinlock(&qlock);
+                return;
+            }
             sdWaitForInterrupt(INT_DATA_DONE);
         }
 
@@ -685,7 +721,10 @@ void sdrw(struct buf *b) {
 /* SD card test and benchmark. */
 void sd_test() {
     static struct buf b[1 << 11];
+    static u32 data[1 << 11][BSIZE / 4];
     int n = sizeof(b) / sizeof(b[0]);
+    for (int i = 0; i < n; i++)
+        b[i].data = (u8 *)data[i];
     int mb = (n * BSIZE) >> 20;
     assert(mb);
     i64 f, t;
@@ -706,7 +745,7 @@ void sd_test() {
             b[i].data[j] = (u8)((i * j) & 0xFF);
         sdrw(&b[i]);
 
-        memset(b[i].data, 0, sizeof(b[i].data));
+        memset(b[i].data, 0, BSIZE);
         // Read back and check
         b[i].flags = 0;
         sdrw(&b[i]);
@@ -756,6 +795,32 @@ void sd_test() {
            t,
            mb * f / t,
            (mb * f * 10 / t) % 10);
+
+    // Multi-block read benchmark
+    static u8 *vec[1 << 11];
+    for (int i = 0; i < n; i++)
+        vec[i] = b[i].data;
+    disb();
+    t = (i64)timestamp();
+    disb();
+    for (int i = 0; i < n; i += SD_MAX_MULTI_BLOCKS) {
+        b[0].flags = 0;
+        b[0].blockno = (u32)i;
+        b[0].count = SD_MAX_MULTI_BLOCKS;
+        b[0].vec = vec + i;
+        sdrw(&b[0]);
+    }
+    b[0].count = 0;
+    b[0].vec = NULL;
+    disb();
+    t = (i64)timestamp() - t;
+    disb();
+    printf("- multi-block read %lldB (%lldMB), t: %lld cycles, speed: %lld.%lld MB/s\n",
+           n * BSIZE,
+           mb,
+           t,
+           mb * f / t,
+           (mb * f * 10 / t) % 10);
 }
 
 static int sdDebugResponse(int resp) {
@@ -15,6 +15,9 @@
 #define SD_CARD_ABSENT     11
 #define SD_CARD_REINSERTED 12
 
+// maximum number of blocks in one multi-block command.
+#define SD_MAX_MULTI_BLOCKS 128
+
 #define SD_READ_BLOCKS  0
 #define SD_WRITE_BLOCKS 1
 
@@ -1,20 +1,73 @@
 #include <driver/sd.h>
 #include <fs/block_device.h>
 
-static void sd_read(usize block_no, u8* buffer) {
+// transfer one block. The driver works on `buffer` in place when it is
+// word-aligned, like `Block->data`, and goes through a bounce buffer otherwise.
+static void sd_rw(usize block_no, u8* buffer, bool write) {
+    u32 bounce[BLOCK_SIZE / 4];
+    bool direct = ((usize)buffer & 0x03) == 0;
+
     struct buf b;
     b.blockno = (u32)block_no;
-    b.flags = 0;
+    b.flags = write ? B_DIRTY | B_VALID : 0;
+    b.data = direct ? buffer : (u8*)bounce;
+    b.count = 1;
+    b.vec = NULL;
+    if (write && !direct)
+        memcpy(bounce, buffer, BLOCK_SIZE);
     sdrw(&b);
-    memcpy(buffer, b.data, BLOCK_SIZE);
+    if (!write && !direct)
+        memcpy(buffer, bounce, BLOCK_SIZE);
+}
+
+static void sd_read(usize block_no, u8* buffer) {
+    sd_rw(block_no, buffer, false);
 }
 
 static void sd_write(usize block_no, u8* buffer) {
-    struct buf b;
-    b.blockno = (u32)block_no;
-    b.flags = B_DIRTY | B_VALID;
-    memcpy(b.data, buffer, BLOCK_SIZE);
-    sdrw(&b);
+    sd_rw(block_no, buffer, true);
+}
+
+// multi-block commands need word-aligned buffers, and anything else goes
+// through the single-block path.
+static bool aligned(usize count, u8** buffers) {
+    for (usize i = 0; i < count; i++) {
+        if (((usize)buffers[i]) & 0x03)
+            return false;
+    }
+    return true;
+}
+
+static void sd_rw_many(usize block_no, usize count, u8** buffers, bool write) {
+    while (count > 0) {
+        usize n = MIN(count, (usize)SD_MAX_MULTI_BLOCKS);
+        if (n == 1 || !aligned(n, buffers)) {
+            for (usize i = 0; i < n; i++) {
+                if (write)
+                    sd_write(block_no + i, buffers[i]);
+                else
+                    sd_read(block_no + i, buffers[i]);
+            }
+        } else {
+            struct buf b;
+            b.blockno = (u32)block_no;
+            b.flags = write ? B_DIRTY | B_VALID : 0;
+            b.count = (u32)n;
+            b.vec = buffers;
+            sdrw(&b);
+        }
+        block_no += n;
+        count -= n;
+        buffers += n;
+    }
+}
+
+static void sd_read_many(usize block_no, usize count, u8** buffers) {
+    sd_rw_many(block_no, count, buffers, false);
+}
+
+static void sd_write_many(usize block_no, usize count, u8** buffers) {
+    sd_rw_many(block_no, count, buffers, true);
 }
 
 static u8 sblock_data[BLOCK_SIZE];
@@ -27,6 +80,8 @@ void init_block_device() {
 
     block_device.read = sd_read;
     block_device.write = sd_write;
+    block_device.read_many = sd_read_many;
+    block_device.write_many = sd_write_many;
 }
 
 const SuperBlock* get_super_block() {
@@ -10,6 +10,14 @@ typedef struct {
     // write `BLOCK_SIZE` bytes from `buffer` to block at `block_no`.
     // caller must guarantee `buffer` contains at least `BLOCK_SIZE` bytes.
     void (*write)(usize block_no, u8 *buffer);
+
+    // read `count` consecutive blocks from `block_no`. The i-th block goes to
+    // `buffers[i]`, which must hold at least `BLOCK_SIZE` bytes.
+    void (*read_many)(usize block_no, usize count, u8 **buffers);
+
+    // write `count` consecutive blocks from `block_no`. The i-th block comes
+    // from `buffers[i]`.
+    void (*write_many)(usize block_no, usize count, u8 **buffers);
 } BlockDevice;
 
 extern BlockDevice block_device;
@@ -10,19 +10,184 @@
 static const SuperBlock* sblock;
 static const BlockDevice* device;
 
-static SpinLock lock;     // protects block cache.
-static Arena arena;       // memory pool for `Block` struct.
-static ListNode head;     // the list of all allocated in-memory block.
-static LogHeader header;  // in-memory copy of log header block.
+// replacement queues of a shard. Every cached block is on one of them.
+// `CACHE_POLICY_LRU` only uses `QUEUE_HOT`.
+enum { QUEUE_HOT, QUEUE_COLD, NUM_QUEUES };
+
+typedef struct ReplacementPolicy ReplacementPolicy;
+
+// the content of blocks is kept apart from `Block` struct, in whole pages of
+// `BUFFERS_PER_SLAB` buffers each. The buffers are page-aligned, and the
+// structs are packed densely in the arena.
+#define BUFFERS_PER_SLAB (PAGE_SIZE / BLOCK_SIZE)
+#define SLAB_FULL        ((u32)BIT(BUFFERS_PER_SLAB) - 1)
+
+typedef struct BufferSlab BufferSlab;
+
+// a page of block buffers.
+struct BufferSlab {
+    ListNode node;  // position in the slabs of its shard.
+    u8* page;
+    u32 used;  // bit `i` is set if buffer `i` belongs to a block.
+};
+
+// hash buckets take whole pages, so that the table of a shard grows a page at
+// a time.
+#define BUCKETS_PER_PAGE (PAGE_SIZE / sizeof(ListNode))
+
+// a shard of the block cache. Blocks are distributed to shards by `block_no`.
+typedef struct {
+    SpinLock lock;     // protects this shard.
+    Arena arena;       // memory pool for `Block` struct.
+    Arena slab_arena;  // memory pool for `BufferSlab` struct.
+    ListNode slabs;    // buffer slabs, those with free buffers first.
+    const ReplacementPolicy* policy;
+    ListNode queues[NUM_QUEUES];  // new and recently used blocks are at the head.
+    usize queue_size[NUM_QUEUES];
+    ListNode* buckets[CACHE_HASH_MAX_PAGES];  // pages of hash chains.
+    usize num_buckets;                        // a power of two.
+    usize num_cached;  // number of allocated `Block` struct in this shard.
+    usize clock;       // number of blocks ever allocated in this shard.
+    usize ghosts[CACHE_GHOST_SIZE];  // `block_no` of blocks recently evicted
+                                     // from `QUEUE_COLD`, for `CACHE_POLICY_2Q`.
+    usize num_ghosts;  // `ghosts[num_ghosts % CACHE_GHOST_SIZE]` is the oldest.
+} CacheShard;
+
+// a replacement policy decides the order in which unused blocks of a shard
+// are evicted, by arranging them in the queues of the shard. Each queue is
+// evicted from its tail. All callbacks are called with the shard lock held.
+struct ReplacementPolicy {
+    // `block` is newly allocated.
+    void (*insert)(CacheShard* shard, Block* block);
+
+    // `block` is found in the cache.
+    void (*touch)(CacheShard* shard, Block* block);
+
+    // `block` is about to be evicted.
+    void (*evict)(CacheShard* shard, Block* block);
+
+    // fill `queues` with the queues to evict from, in order, and return the
+    // number of them.
+    usize (*order)(CacheShard* shard, int* queues);
+};
+
+static CacheShard shards[CACHE_NUM_SHARDS];
+static usize num_cached;  // number of allocated `Block` struct in all shards.
+static usize capacity;    // see `set_capacity`.
+static bool fixed_capacity;  // is `capacity` set by `set_capacity`?
+static LogHeader header;  // commit record being written or replayed.
+static LogDescriptor descriptors[LOG_MAX_DESCRIPTORS - 1];  // descriptor blocks after `header`.
+static LogStats stats;    // updated with atomic operations.
+static usize num_pinned;  // number of pinned blocks. Atomic.
+
+// the counters of `CacheStats` that change all the time. Each CPU adds to its
+// own slot, so that they do not bounce between the CPUs.
+typedef struct {
+    usize num_hits;
+    usize num_misses;
+    usize num_evictions;
+    usize num_ops;
+    usize num_waits;
+    u64 wait_ticks;
+    usize commit_size[CACHE_STATS_NUM_BUCKETS];
+    usize commit_time[CACHE_STATS_NUM_BUCKETS];  // in microseconds.
+} __attribute__((aligned(64))) CpuStats;
+
+static CpuStats cpu_stats[NCPU];
+
+// add `n` to `field` in the slot of the current CPU. The thread may move to
+// another CPU meanwhile, so it is still an atomic add.
+#define count_stat(field, n) __atomic_fetch_add(&cpu_stats[cpuid()].field, (n), __ATOMIC_RELAXED)
+
+// blocks waiting to be read by the background reader.
+static struct {
+    SpinLock lock;
+    bool has_reader;  // is the background reader thread running?
+    Block* queue[READ_AHEAD_QUEUE_SIZE];
+    usize head, tail;  // `queue[head..tail]` modulo the queue size are pending.
+    Block* batch[READ_AHEAD_BATCH];  // used by the reader only.
+} read_ahead;
+
+// in-memory summary of the bitmap on disk, so that `alloc` goes straight to
+// a bitmap block with free bits. It is rebuilt at boot.
+static struct {
+    SpinLock lock;
+    usize num_bitmap_blocks;
+    // free bits of each bitmap block, not counting bits taken by `alloc`
+    // calls that have not set them yet, nor bits in `num_held`.
+    u16 num_free[CACHE_MAX_BITMAP_BLOCKS];
+    // bits of each bitmap block cleared by `free` in the running transaction.
+    u16 num_held[CACHE_MAX_BITMAP_BLOCKS];
+    usize cursor;  // where the next search starts, after the last allocation.
+} free_space;
+
+// a block freed by the running transaction is still in use as far as replay
+// is concerned, so it is not allocated again before the transaction commits.
+// Otherwise, e.g., a freed directory block could be written in place as file
+// data in `JOURNAL_ORDERED` mode, before the commit record that frees it.
+// For bitmap blocks with `num_held` bits, this is their content before the
+// first of those bits was cleared, and a bit is only taken if it is clear in
+// both. Protected by the lock of the bitmap block.
+static u64 held_bitmaps[CACHE_MAX_BITMAP_BLOCKS][BLOCK_SIZE / sizeof(u64)];
+
+static JournalMode journal_mode;
+
+// file data of the running transaction in `JOURNAL_ORDERED` mode. They are
+// pinned until `commit` writes them in place. Protected by `log.lock`.
+static usize ordered_blocks[LOG_MAX_SIZE];
+
+// a block logged since the last checkpoint. While it is in the running
+// transaction, `data[begin..end]` covers the bytes changed.
+typedef struct {
+    usize block_no;
+    u16 begin, end;
+} LogEntry;
+
+// blocks of the transactions that replay would visit, in log order.
+// Protected by `log.lock`.
+static LogEntry entries[LOG_MAX_ENTRIES];
+
+// buffers of multi-block writes, used by the committer only.
+static usize io_block_nos[LOG_MAX_ENTRIES];
+static Block* io_blocks[LOG_MAX_ENTRIES];
+static u8* io_buffers[LOG_MAX_ENTRIES];
+static u8 delta_buffers[LOG_MAX_SIZE][BLOCK_SIZE];
+
+// in-memory copy of the first block of the logging area.
+static union {
+    LogTail tail;
+    u8 data[BLOCK_SIZE];
+} log_tail;
 
 // hint: you may need some other variables. Just add them here.
 struct LOG {
     /* data */
     SpinLock lock;
-    int outstanding;
+    usize outstanding;  // number of running atomic operations. Atomic.
+    // log blocks taken by committed transactions, by blocks of the running
+    // transaction, by `ordered_blocks`, or reserved by running operations.
+    // Atomic.
+    usize reserved;
+    bool blocked;    // `committing || commit_pending`, for `begin_op` to read without `lock`.
     int committing;
-    int mu;
     int mx;
+    bool has_committer;   // is the background committer thread running?
+    bool commit_pending;  // should the running transaction be committed soon?
+    bool checkpoint_pending;  // should the log be checkpointed after the commit?
+    usize num_entries;       // number of blocks in `entries`.
+    usize num_checkpointed;  // `entries[0..num_checkpointed]` are checkpointed.
+    usize num_committed;     // `entries[0..num_committed]` are committed.
+    usize size;              // number of log blocks after `LogTail`.
+    usize head;              // log block where the next transaction goes.
+    usize tail;              // log block of the first transaction not checkpointed.
+    usize num_used;          // log blocks from `tail` to `head`.
+    usize num_replayable;    // log blocks from `LogTail.start` to `head`.
+    usize record_seq;        // sequence number of the next commit record.
+    usize tail_seq;          // sequence number of the transaction at `tail`.
+    usize num_ordered;    // number of blocks in `ordered_blocks`.
+    usize num_ticks;      // clock ticks since the running transaction got dirty.
+    usize seq;            // sequence number of the running transaction.
+    usize done;           // sequence number of the last committed transaction.
 } log;
 
 // read the content from disk.
@@ -38,124 +203,772 @@ static INLINE void device_write(Block* block) {
     device->write(block->block_no + 0x20800, block->data);
 }
 
-// read log header from disk.
-static INLINE void read_header() {
-    device->read(sblock->log_start, (u8*)&header);
+// read/write `count` consecutive blocks from `block_no`.
+static INLINE void device_read_many(usize block_no, usize count, u8** buffers) {
+    device->read_many(block_no + 0x20800, count, buffers);
+}
+
+static INLINE void device_write_many(usize block_no, usize count, u8** buffers) {
+    device->write_many(block_no + 0x20800, count, buffers);
+}
+
+// the block number of log block `index`, counted from `LogTail`.
+static INLINE usize log_block_no(usize index) {
+    return sblock->log_start + 1 + index % log.size;
+}
+
+// write `log_tail` back to disk.
+static INLINE void write_log_tail() {
+    device->write(sblock->log_start, log_tail.data);
 }
 
-// write log header back to disk.
-static INLINE void write_header() {
-    device->write(sblock->log_start, (u8*)&header);
+// the bucket of `value` in the histograms of `CacheStats`.
+static INLINE usize stat_bucket(u64 value) {
+    usize i = value == 0 ? 0 : 64 - (usize)__builtin_clzll(value);
+    return MIN(i, (usize)CACHE_STATS_NUM_BUCKETS - 1);
+}
+
+// convert a duration measured by `get_timestamp` to microseconds.
+static INLINE u64 ticks_to_us(u64 ticks) {
+    return ticks / MAX(get_clock_frequency() / 1000000, (u64)1);
 }
 
 // initialize a block struct.
 static void init_block(Block* block) {
     block->block_no = 0;
     init_list_node(&block->node);
-    block->acquired = false;
+    block->queue = QUEUE_HOT;
+    block->stamp = 0;
+    init_list_node(&block->hash_node);
+    block->rc = 0;
     block->pinned = false;
 
     init_sleeplock(&block->lock, "block");
-    // printf("%d\n", (void*)(block->data) - (void*)block);
     block->valid = false;
-    memset(block->data, 0, sizeof(block->data));
+    block->data = NULL;
+    block->slab = NULL;
 }
 
-// see `cache.h`.
-static usize get_num_cached_blocks() {
-    // TODO
-    ListNode* p = head.next;
-    usize ret = 0;
-    while (p != &head) {
+// return the shard where `block_no` lives.
+static INLINE CacheShard* get_shard(usize block_no) {
+    return &shards[block_no % CACHE_NUM_SHARDS];
+}
+
+// return the hash chain where `block_no` lives.
+static INLINE ListNode* get_bucket(CacheShard* shard, usize block_no) {
+    usize i = (block_no / CACHE_NUM_SHARDS) & (shard->num_buckets - 1);
+    return &shard->buckets[i / BUCKETS_PER_PAGE][i % BUCKETS_PER_PAGE];
+}
+
+// take a page of empty hash chains. Return NULL if `kalloc` runs out.
+static ListNode* alloc_buckets() {
+    ListNode* buckets = kalloc();
+    if (buckets) {
+        for (usize i = 0; i < BUCKETS_PER_PAGE; i++) {
+            init_list_node(&buckets[i]);
+        }
+    }
+    return buckets;
+}
+
+// double the hash buckets of `shard` once it caches more than
+// `CACHE_HASH_LOAD` blocks per bucket. The blocks of bucket `i` are split
+// between bucket `i` and the new bucket `i + n`, where `n` is the old number
+// of buckets. Without free pages, the table stays as it is.
+// caller must hold the lock of `shard`.
+static void grow_buckets(CacheShard* shard) {
+    usize n = shard->num_buckets, num_pages = n / BUCKETS_PER_PAGE;
+    if (shard->num_cached < n * CACHE_HASH_LOAD || 2 * num_pages > CACHE_HASH_MAX_PAGES)
+        return;
+    for (usize i = num_pages; i < 2 * num_pages; i++) {
+        shard->buckets[i] = alloc_buckets();
+        if (!shard->buckets[i]) {
+            for (usize j = num_pages; j < i; j++) {
+                kfree(shard->buckets[j]);
+            }
+            return;
+        }
+    }
+
+    shard->num_buckets = 2 * n;
+    for (usize i = 0; i < n; i++) {
+        ListNode* bucket = &shard->buckets[i / BUCKETS_PER_PAGE][i % BUCKETS_PER_PAGE];
+        ListNode* p = bucket->next;
+        while (p != bucket) {
+            Block* b = container_of(p, Block, hash_node);
+            p = p->next;
+            ListNode* target = get_bucket(shard, b->block_no);
+            if (target != bucket) {
+                detach_from_list(&b->hash_node);
+                merge_list(target, &b->hash_node);
+            }
+        }
+    }
+}
+
+// find the cached block of `block_no`. Return NULL if it is not cached.
+// caller must hold the lock of `shard`.
+static Block* lookup_block(CacheShard* shard, usize block_no) {
+    ListNode* bucket = get_bucket(shard, block_no);
+    for (ListNode* p = bucket->next; p != bucket; p = p->next) {
+        Block* b = container_of(p, Block, hash_node);
+        if (b->block_no == block_no)
+            return b;
+    }
+    return NULL;
+}
+
+// put `block` at the head of `queue`.
+static INLINE void enqueue(CacheShard* shard, Block* block, int queue) {
+    block->queue = queue;
+    merge_list(&shard->queues[queue], &block->node);
+    shard->queue_size[queue]++;
+}
+
+// take `block` off its queue.
+static INLINE void dequeue(CacheShard* shard, Block* block) {
+    detach_from_list(&block->node);
+    shard->queue_size[block->queue]--;
+}
+
+// LRU: one queue ordered by the last use.
+
+static void lru_insert(CacheShard* shard, Block* block) {
+    enqueue(shard, block, QUEUE_HOT);
+}
+
+static void lru_touch(CacheShard* shard, Block* block) {
+    dequeue(shard, block);
+    enqueue(shard, block, QUEUE_HOT);
+}
+
+static void lru_evict(CacheShard* shard, Block* block) {
+    (void)shard;
+    (void)block;
+}
+
+static usize lru_order(CacheShard* shard, int* queues) {
+    (void)shard;
+    queues[0] = QUEUE_HOT;
+    return 1;
+}
+
+// 2Q: new blocks enter `QUEUE_COLD` in FIFO order. A block is promoted to
+// `QUEUE_HOT`, an LRU list, when it is used again after at least half of
+// the cold share of the shard has been allocated since it came in, or when
+// it comes back soon after being evicted from `QUEUE_COLD`. Repeated uses
+// within a short period, e.g. a file read in small pieces, do not count.
+// Cold blocks are evicted first as long as they take more than their share,
+// a quarter of the capacity, so a long sequential read only cycles through
+// `QUEUE_COLD`.
+
+// the number of blocks of a shard `QUEUE_COLD` may keep before `QUEUE_HOT`
+// has to give up blocks.
+static INLINE usize cold_share() {
+    return __atomic_load_n(&capacity, __ATOMIC_RELAXED) / CACHE_NUM_SHARDS / 4;
+}
+
+// forget `block_no` if it has been evicted from `QUEUE_COLD` recently.
+// return whether it has.
+static bool forget_ghost(CacheShard* shard, usize block_no) {
+    for (usize i = 0; i < CACHE_GHOST_SIZE; i++) {
+        if (shard->ghosts[i] == block_no) {
+            shard->ghosts[i] = (usize)-1;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void twoq_insert(CacheShard* shard, Block* block) {
+    enqueue(shard, block, forget_ghost(shard, block->block_no) ? QUEUE_HOT : QUEUE_COLD);
+}
+
+static void twoq_touch(CacheShard* shard, Block* block) {
+    if (block->queue == QUEUE_COLD && shard->clock - block->stamp < cold_share() / 2)
+        return;
+    dequeue(shard, block);
+    enqueue(shard, block, QUEUE_HOT);
+}
+
+static void twoq_evict(CacheShard* shard, Block* block) {
+    if (block->queue == QUEUE_COLD)
+        shard->ghosts[shard->num_ghosts++ % CACHE_GHOST_SIZE] = block->block_no;
+}
+
+static usize twoq_order(CacheShard* shard, int* queues) {
+    bool cold_first = shard->queue_size[QUEUE_COLD] > cold_share();
+    queues[0] = cold_first ? QUEUE_COLD : QUEUE_HOT;
+    queues[1] = cold_first ? QUEUE_HOT : QUEUE_COLD;
+    return 2;
+}
+
+static const ReplacementPolicy policies[CACHE_NUM_POLICIES] = {
+    [CACHE_POLICY_LRU] =
+        {
+            .insert = lru_insert,
+            .touch = lru_touch,
+            .evict = lru_evict,
+            .order = lru_order,
+        },
+    [CACHE_POLICY_2Q] =
+        {
+            .insert = twoq_insert,
+            .touch = twoq_touch,
+            .evict = twoq_evict,
+            .order = twoq_order,
+        },
+};
+
+// give `block` a buffer from the slabs of `shard`, taking a new page if all
+// slabs are full.
+// caller must hold the lock of `shard`.
+static void alloc_buffer(CacheShard* shard, Block* block) {
+    BufferSlab* slab = NULL;
+    if (shard->slabs.next != &shard->slabs) {
+        slab = container_of(shard->slabs.next, BufferSlab, node);
+        if (slab->used == SLAB_FULL)
+            slab = NULL;
+    }
+    if (!slab) {
+        slab = alloc_object(&shard->slab_arena);
+        slab->page = kalloc();
+        if (!slab->page)
+            PANIC("out of memory for block buffers");
+        slab->used = 0;
+        init_list_node(&slab->node);
+        merge_list(&shard->slabs, &slab->node);
+    }
+
+    usize i = (usize)__builtin_ctz(~slab->used);
+    slab->used |= 1u << i;
+    block->data = slab->page + i * BLOCK_SIZE;
+    block->slab = slab;
+    // full slabs go to the tail.
+    if (slab->used == SLAB_FULL) {
+        detach_from_list(&slab->node);
+        merge_list(shard->slabs.prev, &slab->node);
+    }
+}
+
+// return the buffer of `block` to its slab. Empty slabs are kept until
+// `free_empty_slabs`.
+// caller must hold the lock of `shard`.
+static void free_buffer(CacheShard* shard, Block* block) {
+    BufferSlab* slab = block->slab;
+    slab->used &= ~(1u << ((usize)(block->data - slab->page) / BLOCK_SIZE));
+    detach_from_list(&slab->node);
+    merge_list(&shard->slabs, &slab->node);
+}
+
+// give the pages of `shard` that hold no block back to `kalloc`.
+// return the number of pages freed.
+// caller must hold the lock of `shard`.
+static usize free_empty_slabs(CacheShard* shard) {
+    usize num_freed = 0;
+    ListNode* p = shard->slabs.next;
+    while (p != &shard->slabs) {
+        BufferSlab* slab = container_of(p, BufferSlab, node);
         p = p->next;
-        ret++;
+        if (slab->used == 0) {
+            detach_from_list(&slab->node);
+            kfree(slab->page);
+            free_object(slab);
+            num_freed++;
+        }
     }
-    return ret;
+    return num_freed + shrink_arena(&shard->arena) + shrink_arena(&shard->slab_arena);
 }
 
-// see `cache.h`.
-static Block* cache_acquire(usize block_no) {
-    // TODO
-    // printf("acq %d locked%d cpu%x thiscpu%x\n", block_no, lock.locked,
-    // lock.cpu,
-    //        thiscpu());
-    acquire_spinlock(&lock);
-    bool IsTheBlockInCache = false;
-    ListNode* p = head.next;
-    while (p != &head) {
-        Block* b = container_of(p, Block, node);
-        if (b->block_no == block_no) {
-            IsTheBlockInCache = true;
+// drop `block` from the cache. It must be neither used nor pinned.
+// caller must hold the lock of `shard`.
+static void evict_block(CacheShard* shard, Block* block) {
+    shard->policy->evict(shard, block);
+    dequeue(shard, block);
+    detach_from_list(&block->hash_node);
+    free_buffer(shard, block);
+    free_object(block);
+    shard->num_cached--;
+    __atomic_fetch_sub(&num_cached, 1, __ATOMIC_ACQ_REL);
+    count_stat(num_evictions, 1);
+}
+
+// evict unused blocks in `shard` in the order of its replacement policy,
+// until the whole cache is below its capacity. Blocks that are in use or
+// pinned are skipped.
+// return true if the cache has room for a new block afterwards.
+// caller must hold the lock of `shard`.
+static bool evict_blocks(CacheShard* shard) {
+    usize limit = __atomic_load_n(&capacity, __ATOMIC_RELAXED);
+    int queues[NUM_QUEUES];
+    usize n = shard->policy->order(shard, queues);
+    for (usize i = 0; i < n; i++) {
+        ListNode* head = &shard->queues[queues[i]];
+        ListNode* p = head->prev;
+        while (__atomic_load_n(&num_cached, __ATOMIC_ACQUIRE) >= limit && p != head) {
+            Block* b = container_of(p, Block, node);
+            p = p->prev;
+            if (b->rc == 0 && !b->pinned)
+                evict_block(shard, b);
+        }
+    }
+    return __atomic_load_n(&num_cached, __ATOMIC_ACQUIRE) < limit;
+}
+
+// the shard of `block_no` has nothing left to evict, so borrow room from
+// the other shards.
+// caller must NOT hold any shard lock.
+static void borrow_blocks(usize block_no) {
+    for (usize i = 1; i < CACHE_NUM_SHARDS; i++) {
+        CacheShard* shard = get_shard(block_no + i);
+        acquire_spinlock(&shard->lock);
+        bool done = shard->num_cached > 0 && evict_blocks(shard);
+        release_spinlock(&shard->lock);
+        if (done)
             break;
+    }
+}
+
+// drop unused blocks of `shard` in the order of its replacement policy, and
+// give the pages emptied back to `kalloc`, until `num_pages` pages are freed
+// or no unused block is left. Unused blocks are clean, since changed blocks
+// stay pinned until they are checkpointed.
+// return the number of pages freed.
+// caller must hold the lock of `shard`.
+static usize shrink_shard(CacheShard* shard, usize num_pages) {
+    // a page is freed only when all its blocks are gone, so blocks are dropped
+    // in batches of at least `num_pages` pages' worth.
+    usize batch = num_pages * BUFFERS_PER_SLAB;
+    usize num_freed = 0;
+    bool more = true;
+    while (num_freed < num_pages && more) {
+        int queues[NUM_QUEUES];
+        usize n = shard->policy->order(shard, queues);
+        usize num_evicted = 0;
+        for (usize i = 0; i < n && num_evicted < batch; i++) {
+            ListNode* head = &shard->queues[queues[i]];
+            ListNode* p = head->prev;
+            while (num_evicted < batch && p != head) {
+                Block* b = container_of(p, Block, node);
+                p = p->prev;
+                if (b->rc == 0 && !b->pinned) {
+                    evict_block(shard, b);
+                    num_evicted++;
+                }
+            }
         }
-        p = p->next;
+        more = num_evicted == batch;
+        num_freed += free_empty_slabs(shard);
+    }
+    return num_freed;
+}
+
+// the reclaim hook of the block cache, see `ReclaimHook`.
+static usize cache_reclaim(usize num_pages) {
+    usize num_freed = 0;
+    for (usize i = 0; i < CACHE_NUM_SHARDS && num_freed < num_pages; i++) {
+        CacheShard* shard = &shards[i];
+        // the caller of `kalloc` may be adding a block to this shard.
+        if (!try_acquire_spinlock(&shard->lock))
+            continue;
+        num_freed += shrink_shard(shard, num_pages - num_freed);
+        release_spinlock(&shard->lock);
+    }
+    // stop growing until memory is plentiful again.
+    if (!__atomic_load_n(&fixed_capacity, __ATOMIC_RELAXED)) {
+        usize n = __atomic_load_n(&num_cached, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&capacity, MAX(n, (usize)1), __ATOMIC_RELAXED);
     }
+    return num_freed;
+}
+
+// let the cache take one more block instead of evicting one, if its capacity
+// is not fixed and `kalloc` has plenty of free pages.
+static INLINE void grow_capacity() {
+    if (!__atomic_load_n(&fixed_capacity, __ATOMIC_RELAXED) &&
+        __atomic_load_n(&num_cached, __ATOMIC_ACQUIRE) >=
+            __atomic_load_n(&capacity, __ATOMIC_RELAXED) &&
+        get_num_free_pages() > CACHE_MIN_FREE_PAGES)
+        __atomic_fetch_add(&capacity, 1, __ATOMIC_RELAXED);
+}
+
+// see `cache.h`.
+static usize get_num_cached_blocks() {
+    return __atomic_load_n(&num_cached, __ATOMIC_ACQUIRE);
+}
 
-    if (IsTheBlockInCache) {
-        detach_from_list(p);
-        merge_list(&head, p);
-        Block* b = container_of(p, Block, node);
-        // printf("rel1 %d locked%d cpu%x thiscpu%x\n", block_no, lock.locked,
-        //        lock.cpu, thiscpu());
-        release_spinlock(&lock);
-        acquire_sleeplock(&b->lock);
-        return b;
-    }
-    usize sz = get_num_cached_blocks();
-    if (sz >= EVICTION_THRESHOLD) {
-        ListNode* q = head.prev;
-        while (sz >= EVICTION_THRESHOLD && q != &head) {
-            Block* b = container_of(q, Block, node);
-            if (b->pinned == false && b->acquired == false) {
-                ListNode* t = detach_from_list(q);
-                free_object(b);
-                q = t;
-                sz--;
-            } else
-                q = q->prev;
+// see `cache.h`.
+static void cache_set_capacity(usize num_blocks) {
+    if (num_blocks == 0)
+        PANIC("empty block cache");
+    __atomic_store_n(&fixed_capacity, true, __ATOMIC_RELAXED);
+    __atomic_store_n(&capacity, num_blocks, __ATOMIC_RELAXED);
+    for (usize i = 0; i < CACHE_NUM_SHARDS; i++) {
+        acquire_spinlock(&shards[i].lock);
+        evict_blocks(&shards[i]);
+        release_spinlock(&shards[i].lock);
+    }
+}
+
+// see `cache.h`.
+static usize cache_get_capacity() {
+    return __atomic_load_n(&capacity, __ATOMIC_RELAXED);
+}
+
+// forget the history of the replacement policy of `shard`.
+// caller must hold the lock of `shard`.
+static void reset_policy(CacheShard* shard) {
+    // cold blocks are older than hot ones, so they go to the tail.
+    ListNode* cold = &shard->queues[QUEUE_COLD];
+    while (cold->next != cold) {
+        Block* b = container_of(cold->prev, Block, node);
+        dequeue(shard, b);
+        b->queue = QUEUE_HOT;
+        merge_list(shard->queues[QUEUE_HOT].prev, &b->node);
+        shard->queue_size[QUEUE_HOT]++;
+    }
+    for (usize i = 0; i < CACHE_GHOST_SIZE; i++) {
+        shard->ghosts[i] = (usize)-1;
+    }
+    shard->num_ghosts = 0;
+}
+
+// see `cache.h`.
+static void cache_set_policy(CachePolicy policy) {
+    if (policy >= CACHE_NUM_POLICIES)
+        PANIC("unknown cache policy");
+    for (usize i = 0; i < CACHE_NUM_SHARDS; i++) {
+        CacheShard* shard = &shards[i];
+        acquire_spinlock(&shard->lock);
+        reset_policy(shard);
+        shard->policy = &policies[policy];
+        release_spinlock(&shard->lock);
+    }
+}
+
+// find the cached block of `block_no`, or allocate a new one, and take a
+// reference to it. `*created` tells whether it is newly allocated.
+static Block* get_block(usize block_no, bool* created) {
+    CacheShard* shard = get_shard(block_no);
+
+    acquire_spinlock(&shard->lock);
+    Block* b = lookup_block(shard, block_no);
+    if (!b) {
+        grow_capacity();
+        // make room before the new block comes in. If this shard has nothing
+        // left to evict, the room is borrowed from the others, and someone
+        // may add the block in the meantime.
+        if (!evict_blocks(shard)) {
+            release_spinlock(&shard->lock);
+            borrow_blocks(block_no);
+            acquire_spinlock(&shard->lock);
+            b = lookup_block(shard, block_no);
         }
     }
-    Block* b = alloc_object(&arena);
-    init_block(b);
-    p = &b->node;
-    merge_list(&head, p);
-    b->block_no = block_no;
-    // printf("rel2 %d locked%d cpu%x thiscpu%x\n", block_no, lock.locked,
-    //        lock.cpu, thiscpu());
-    release_spinlock(&lock);
+    *created = b == NULL;
+    if (b) {
+        shard->policy->touch(shard, b);
+    } else {
+        grow_buckets(shard);
+        b = alloc_object(&shard->arena);
+        init_block(b);
+        alloc_buffer(shard, b);
+        b->block_no = block_no;
+        b->stamp = shard->clock++;
+        merge_list(get_bucket(shard, block_no), &b->hash_node);
+        shard->num_cached++;
+        __atomic_fetch_add(&num_cached, 1, __ATOMIC_ACQ_REL);
+        shard->policy->insert(shard, b);
+    }
+    b->rc++;
+    release_spinlock(&shard->lock);
+    return b;
+}
+
+// drop a reference taken by `get_block`.
+static void put_block(Block* block) {
+    CacheShard* shard = get_shard(block->block_no);
+    acquire_spinlock(&shard->lock);
+    block->rc--;
+    release_spinlock(&shard->lock);
+}
+
+// see `cache.h`.
+static Block* cache_acquire(usize block_no) {
+    bool created;
+    Block* b = get_block(block_no, &created);
     acquire_sleeplock(&b->lock);
-    device_read(b);
-    b->valid = 1;
-    b->acquired = 1;
+    if (!b->valid) {
+        device_read(b);
+        b->valid = true;
+        count_stat(num_misses, 1);
+    } else {
+        count_stat(num_hits, 1);
+    }
+    return b;
+}
 
+// see `cache.h`.
+static Block* cache_acquire_new(usize block_no) {
+    bool created;
+    Block* b = get_block(block_no, &created);
+    acquire_sleeplock(&b->lock);
+    memset(b->data, 0, BLOCK_SIZE);
+    b->valid = true;
     return b;
 }
 
 // see `cache.h`.
 static void cache_release(Block* block) {
-    // TODO
-    block->acquired = false;
     release_sleeplock(&block->lock);
+    put_block(block);
+}
+
+// see `cache.h`.
+static void cache_prefetch(usize block_no) {
+    acquire_spinlock(&read_ahead.lock);
+    if (!read_ahead.has_reader || read_ahead.tail - read_ahead.head >= READ_AHEAD_QUEUE_SIZE) {
+        release_spinlock(&read_ahead.lock);
+        return;
+    }
+
+    // a block that is already cached is either valid or being read by someone.
+    // the queue keeps the reference of a new block, so it is not evicted
+    // before the reader gets to it.
+    bool created;
+    Block* b = get_block(block_no, &created);
+    if (created) {
+        read_ahead.queue[read_ahead.tail++ % READ_AHEAD_QUEUE_SIZE] = b;
+        wakeup(&read_ahead);
+    }
+    release_spinlock(&read_ahead.lock);
+
+    if (!created)
+        put_block(b);
+}
+
+// lock `block`, a block queued for the background reader, if nobody else
+// holds or waits for it, so that the lock is taken at once. Return false if
+// the block is in use or has been read by someone in the meantime.
+static bool lock_unshared(Block* block) {
+    CacheShard* shard = get_shard(block->block_no);
+    acquire_spinlock(&shard->lock);
+    bool unshared = block->rc == 1;
+    if (unshared)
+        acquire_sleeplock(&block->lock);
+    release_spinlock(&shard->lock);
+    if (unshared && block->valid) {
+        release_sleeplock(&block->lock);
+        return false;
+    }
+    return unshared;
+}
+
+// see `cache.h`.
+NO_RETURN void bcache_reader() {
+    acquire_spinlock(&read_ahead.lock);
+    read_ahead.has_reader = true;
+    for (;;) {
+        while (read_ahead.head == read_ahead.tail) {
+            sleep(&read_ahead, &read_ahead.lock);
+        }
+        // take a run of consecutive blocks for one multi-block read.
+        Block** batch = read_ahead.batch;
+        usize n = 0;
+        do {
+            batch[n++] = read_ahead.queue[read_ahead.head++ % READ_AHEAD_QUEUE_SIZE];
+        } while (n < READ_AHEAD_BATCH && read_ahead.head != read_ahead.tail &&
+                 read_ahead.queue[read_ahead.head % READ_AHEAD_QUEUE_SIZE]->block_no ==
+                     batch[n - 1]->block_no + 1);
+        release_spinlock(&read_ahead.lock);
+
+        // read straight into the buffers of the blocks, with their locks held.
+        // Only the first block of each read may wait for its lock, so that the
+        // reader never waits while holding others. The read stops before a
+        // block that someone else uses, which is read by itself afterwards.
+        u8* buffers[READ_AHEAD_BATCH];
+        for (usize i = 0, j; i < n; i = j) {
+            acquire_sleeplock(&batch[i]->lock);
+            if (batch[i]->valid) {
+                cache_release(batch[i]);
+                j = i + 1;
+                continue;
+            }
+            for (j = i + 1; j < n && lock_unshared(batch[j]); j++) {
+            }
+            for (usize k = i; k < j; k++) {
+                buffers[k] = batch[k]->data;
+            }
+            device_read_many(batch[i]->block_no, j - i, buffers + i);
+            for (usize k = i; k < j; k++) {
+                batch[k]->valid = true;
+                cache_release(batch[k]);
+            }
+        }
+
+        acquire_spinlock(&read_ahead.lock);
+    }
+}
+
+// mark whether `block` can be evicted from cache.
+static void set_pinned(Block* block, bool pinned) {
+    CacheShard* shard = get_shard(block->block_no);
+    acquire_spinlock(&shard->lock);
+    if (block->pinned != pinned)
+        __atomic_fetch_add(&num_pinned, pinned ? 1 : (usize)-1, __ATOMIC_RELAXED);
+    block->pinned = pinned;
+    release_spinlock(&shard->lock);
 }
 
-void install_trans(int recovering) {
-    for (u32 tail = 0; tail < header.num_blocks; tail++) {
-        Block* lbuf = cache_acquire((usize)(sblock->log_start + tail + 1));
-        Block* dbuf = cache_acquire((usize)(header.block_no[tail]));
-        memmove(dbuf->data, lbuf->data, BLOCK_SIZE);
+// apply the `LogDelta` records packed in a log block.
+static void install_deltas(const u8* data) {
+    for (usize i = 0; i + sizeof(LogDelta) <= BLOCK_SIZE;) {
+        const LogDelta* delta = (const LogDelta*)(data + i);
+        if (delta->num_bytes == 0)
+            break;
+        if (delta->offset + delta->num_bytes > BLOCK_SIZE)
+            PANIC("corrupted log delta");
+        Block* dbuf = cache_acquire(delta->block_no);
+        memmove(dbuf->data + delta->offset, delta + 1, delta->num_bytes);
         device_write(dbuf);
-        if (recovering)
-            dbuf->pinned = 0;
-        cache_release(lbuf);
         cache_release(dbuf);
+        i += sizeof(LogDelta) + round_up(delta->num_bytes, 8);
     }
 }
 
-void recover_from_log() {
-    read_header();
-    install_trans(1);
-    header.num_blocks = 0;
-    write_header();
+// where the block number of log block `i` of the transaction in `header` is.
+static INLINE u32* trans_block_no(usize i) {
+    if (i < LOG_HEADER_NUM_BLOCKS)
+        return &header.block_no[i];
+    i -= LOG_HEADER_NUM_BLOCKS;
+    return &descriptors[i / LOG_DESCRIPTOR_NUM_BLOCKS].block_no[i % LOG_DESCRIPTOR_NUM_BLOCKS];
+}
+
+// read the descriptor blocks of the transaction at log block `start` into
+// `header` and `descriptors`, and return whether it is the one numbered `seq`
+// and made it to disk in whole.
+static bool read_trans(usize start, usize seq) {
+    Block* lbuf = cache_acquire(log_block_no(start));
+    memmove(&header, lbuf->data, BLOCK_SIZE);
+    cache_release(lbuf);
+    if (header.magic != LOG_MAGIC || header.seq != seq || header.num_blocks > LOG_MAX_SIZE ||
+        header.num_descriptors != LOG_NUM_DESCRIPTORS(header.num_blocks) ||
+        header.num_descriptors + header.num_blocks > log.size)
+        return false;
+
+    u32 checksum = header.checksum;
+    header.checksum = 0;
+    u32 sum = log_checksum(LOG_CHECKSUM_INIT, (const u8*)&header);
+    header.checksum = checksum;
+    for (usize i = 1; i < header.num_descriptors; i++) {
+        lbuf = cache_acquire(log_block_no(start + i));
+        memmove(&descriptors[i - 1], lbuf->data, BLOCK_SIZE);
+        sum = log_checksum(sum, lbuf->data);
+        cache_release(lbuf);
+    }
+    for (usize i = 0; i < header.num_blocks; i++) {
+        lbuf = cache_acquire(log_block_no(start + header.num_descriptors + i));
+        sum = log_checksum(sum, lbuf->data);
+        cache_release(lbuf);
+    }
+    return sum == checksum;
+}
+
+// install the transaction in `header`, which starts at log block `start`.
+static void install_trans(usize start) {
+    for (usize i = 0; i < header.num_blocks; i++) {
+        Block* lbuf = cache_acquire(log_block_no(start + header.num_descriptors + i));
+        u32 block_no = *trans_block_no(i);
+        if (block_no == LOG_DELTA_BLOCK) {
+            install_deltas(lbuf->data);
+        } else {
+            Block* dbuf = cache_acquire(block_no);
+            memmove(dbuf->data, lbuf->data, BLOCK_SIZE);
+            device_write(dbuf);
+            cache_release(dbuf);
+        }
+        cache_release(lbuf);
+    }
+}
+
+// replay the log on disk at boot, from `LogTail` on, up to the first
+// transaction that is missing or torn. Installing a transaction twice does no
+// harm, so replay may revisit checkpointed ones.
+static void recover_from_log() {
+    device->read(sblock->log_start, log_tail.data);
+    usize start = log_tail.tail.start % log.size, seq = log_tail.tail.seq;
+    while (read_trans(start, seq)) {
+        install_trans(start);
+        start = (start + header.num_descriptors + header.num_blocks) % log.size;
+        seq++;
+    }
+
+    log.head = log.tail = start;
+    log.record_seq = log.tail_seq = seq;
+    log.num_used = log.num_replayable = 0;
+    log_tail.tail.start = start;
+    log_tail.tail.seq = seq;
+    write_log_tail();
+}
+
+// the number of bits of bitmap block `i` that stand for existing blocks.
+static INLINE usize bitmap_block_bits(usize i) {
+    return MIN(sblock->num_blocks - i * BIT_PER_BLOCK, (usize)BIT_PER_BLOCK);
+}
+
+// the clear bits of the `w`-th word in a bitmap block with `num_bits` valid
+// bits. Bits are numbered from the least significant bit of the first byte,
+// so on a little-endian machine each `u64` holds 64 consecutive bits.
+static INLINE u64 clear_bits(const u64* words, usize w, usize num_bits) {
+    u64 bits = ~words[w];
+    if ((w + 1) * 64 > num_bits)
+        bits &= BIT(num_bits % 64) - 1;
+    return bits;
+}
+
+// find a clear bit in a bitmap block, starting from `hint` and wrapping
+// around, that is also clear in `held` unless it is NULL. Return
+// `BIT_PER_BLOCK` if there is none.
+static usize find_clear_bit(const u64* words, const u64* held, usize num_bits, usize hint) {
+    usize num_words = (num_bits + 63) / 64;
+    u64 below_hint = BIT(hint % 64) - 1;
+    // the word of `hint` is visited twice: bits from `hint` on first, and
+    // bits below it after wrapping around.
+    for (usize k = 0; k <= num_words; k++) {
+        usize w = (hint / 64 + k) % num_words;
+        u64 bits = clear_bits(words, w, num_bits);
+        if (held)
+            bits &= ~held[w];
+        if (k == 0)
+            bits &= ~below_hint;
+        else if (k == num_words)
+            bits &= below_hint;
+        if (bits)
+            return w * 64 + (usize)__builtin_ctzll(bits);
+    }
+    return BIT_PER_BLOCK;
+}
+
+// count free blocks in every bitmap block.
+static void init_free_space() {
+    usize n = (sblock->num_blocks + BIT_PER_BLOCK - 1) / BIT_PER_BLOCK;
+    if (n > CACHE_MAX_BITMAP_BLOCKS)
+        PANIC("too many bitmap blocks");
+
+    init_spinlock(&free_space.lock, "free space");
+    free_space.num_bitmap_blocks = n;
+    free_space.cursor = 0;
+    for (usize i = 0; i < n; i++) {
+        Block* bp = cache_acquire(sblock->bitmap_start + i);
+        const u64* words = (const u64*)bp->data;
+        usize num_bits = bitmap_block_bits(i), count = 0;
+        for (usize w = 0; w < (num_bits + 63) / 64; w++) {
+            count += (usize)__builtin_popcountll(clear_bits(words, w, num_bits));
+        }
+        cache_release(bp);
+        free_space.num_free[i] = (u16)count;
+        free_space.num_held[i] = 0;
+    }
 }
 
 // initialize block cache.
@@ -165,171 +978,816 @@ void init_bcache(const SuperBlock* _sblock, const BlockDevice* _device) {
 
     // TODO
     ArenaPageAllocator allocator = {.allocate = kalloc, .free = kfree};
-    init_list_node(&head);
+    for (usize i = 0; i < CACHE_NUM_SHARDS; i++) {
+        CacheShard* shard = &shards[i];
+        init_spinlock(&shard->lock, "bcache");
+        init_arena(&shard->arena, sizeof(Block), allocator);
+        init_arena(&shard->slab_arena, sizeof(BufferSlab), allocator);
+        init_list_node(&shard->slabs);
+        shard->policy = &policies[CACHE_POLICY_2Q];
+        for (usize j = 0; j < NUM_QUEUES; j++) {
+            init_list_node(&shard->queues[j]);
+            shard->queue_size[j] = 0;
+        }
+        shard->buckets[0] = alloc_buckets();
+        if (!shard->buckets[0])
+            PANIC("out of memory for block cache");
+        shard->num_buckets = BUCKETS_PER_PAGE;
+        shard->num_cached = 0;
+        shard->clock = 0;
+        reset_policy(shard);
+    }
+    num_cached = 0;
+    capacity = EVICTION_THRESHOLD;
+    fixed_capacity = false;
+    register_reclaim_hook(cache_reclaim);
+    init_spinlock(&read_ahead.lock, "read ahead");
     printf("init bcache\n");
-    init_spinlock(&lock, "bcache");
-    init_arena(&arena, sizeof(Block), allocator);
 
     init_spinlock(&log.lock, "log");
-    log.mu = 0;
+    log.reserved = 0;
+    log.num_entries = 0;
+    log.num_checkpointed = 0;
+    log.num_committed = 0;
+    log.num_ordered = 0;
+    journal_mode = JOURNAL_FULL;
+    log.seq = 1;
+    log.done = 0;
     printf("%d| %d\n", sblock->num_log_blocks - 1, LOG_MAX_SIZE);
-    log.mx = MIN(sblock->num_log_blocks - 1, LOG_MAX_SIZE);
+    // a transaction also takes log blocks for its descriptors.
+    log.size = sblock->num_log_blocks - 1;
+    usize mx = MIN(log.size - 1, (usize)LOG_MAX_SIZE);
+    while (mx + LOG_NUM_DESCRIPTORS(mx) > log.size) {
+        mx--;
+    }
+    log.mx = (int)mx;
     recover_from_log();
+    init_free_space();
+}
+
+// does the running transaction have anything to commit?
+// caller must hold `log.lock`.
+static INLINE bool is_dirty() {
+    return log.num_entries > log.num_committed || log.num_ordered > 0;
+}
+
+// log blocks taken so far, counting one for each block of the running
+// transaction before it is packed by `write_log`.
+// caller must hold `log.lock`.
+static INLINE usize num_log_slots() {
+    return log.num_used + (log.num_entries - log.num_committed) + log.num_ordered;
+}
+
+// publish `log.blocked` after `committing` or `commit_pending` changes.
+// caller must hold `log.lock`.
+static INLINE void update_blocked() {
+    __atomic_store_n(&log.blocked, log.committing || log.commit_pending, __ATOMIC_SEQ_CST);
+}
+
+// an atomic operation leaves. Whoever waits to commit is woken up when it is
+// the last one.
+// caller must hold `log.lock`.
+static void leave_op() {
+    if (__atomic_sub_fetch(&log.outstanding, 1, __ATOMIC_SEQ_CST) == 0)
+        wakeup(&log.commit_pending);
+}
+
+// ask the committer to commit the running transaction as soon as all
+// outstanding atomic operations end. Without committer, the last `end_op`
+// always commits, so there is nothing to do.
+// caller must hold `log.lock`.
+static void request_commit() {
+    if (!log.has_committer)
+        return;
+    log.commit_pending = true;
+    update_blocked();
+    if (__atomic_load_n(&log.outstanding, __ATOMIC_SEQ_CST) == 0)
+        wakeup(&log.commit_pending);
+}
+
+// like `request_commit`, but also ask the committer to free up the log.
+static void request_checkpoint() {
+    log.checkpoint_pending = true;
+    request_commit();
+}
+
+// try to begin an atomic operation without `log.lock`.
+// an operation shows up in `outstanding` before it checks `blocked`, and a
+// commit sets `blocked` before it checks `outstanding`, so at least one of
+// them sees the other. A commit also moves on to the next `seq` before it
+// clears `blocked`, so the operation never takes the sequence number of a
+// transaction that has been committed without it.
+static bool try_begin_op(OpContext* ctx) {
+    if (__atomic_load_n(&log.blocked, __ATOMIC_SEQ_CST))
+        return false;
+
+    __atomic_fetch_add(&log.outstanding, 1, __ATOMIC_SEQ_CST);
+    usize reserved = __atomic_add_fetch(&log.reserved, ctx->rm, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&log.blocked, __ATOMIC_SEQ_CST) && reserved <= (usize)log.mx) {
+        ctx->ts = __atomic_load_n(&log.seq, __ATOMIC_SEQ_CST);
+        return true;
+    }
+
+    __atomic_fetch_sub(&log.reserved, ctx->rm, __ATOMIC_SEQ_CST);
+    acquire_spinlock(&log.lock);
+    leave_op();
+    wakeup(&log);
+    release_spinlock(&log.lock);
+    return false;
 }
 
 // see `cache.h`.
-static void cache_begin_op(OpContext* ctx) {
-    // TODO
+static void cache_begin_op_sized(OpContext* ctx, usize num_blocks) {
+    if (num_blocks > OP_MAX_NUM_BLOCKS)
+        PANIC("log reservation too large");
+    ctx->rm = num_blocks;
+    ctx->read_only = false;
+    count_stat(num_ops, 1);
+    if (try_begin_op(ctx))
+        return;
+
+    u64 start = get_timestamp();
+    bool waited = false;
     acquire_spinlock(&log.lock);
     while (1) {
-        if (log.committing) {
+        if (log.committing || log.commit_pending) {
             sleep(&log, &log.lock);
-        } else if ((int)header.num_blocks + log.mu + OP_MAX_NUM_BLOCKS >
-                   log.mx) {
+            waited = true;
+        } else if (__atomic_load_n(&log.reserved, __ATOMIC_SEQ_CST) + num_blocks >
+                   (usize)log.mx) {
+            request_checkpoint();
             sleep(&log, &log.lock);
+            waited = true;
         } else {
-            log.outstanding++;
-            log.mu += OP_MAX_NUM_BLOCKS;
-            ctx->rm = OP_MAX_NUM_BLOCKS;
-            ctx->ts = (usize)log.outstanding;
+            __atomic_fetch_add(&log.outstanding, 1, __ATOMIC_SEQ_CST);
+            __atomic_fetch_add(&log.reserved, num_blocks, __ATOMIC_SEQ_CST);
+            ctx->ts = log.seq;
             release_spinlock(&log.lock);
             break;
         }
     }
+    if (waited) {
+        count_stat(num_waits, 1);
+        count_stat(wait_ticks, get_timestamp() - start);
+    }
 }
 
 // see `cache.h`.
-static void cache_sync(OpContext* ctx, Block* block) {
-    if (ctx) {
-        // TODO
-        acquire_spinlock(&log.lock);
-        if ((int)header.num_blocks >= log.mx) {
-            PANIC("too big a transaction");
-        }
-        if (log.outstanding < 1)
-            PANIC("log_write outside of trans");
-        usize cnt = header.num_blocks, i;
-        for (i = 0; i < cnt; i++) {
-            if (header.block_no[i] == block->block_no) {
-                break;
-            }
+static void cache_begin_op(OpContext* ctx) {
+    cache_begin_op_sized(ctx, OP_MAX_NUM_BLOCKS);
+}
+
+// see `cache.h`.
+static void cache_begin_read_op(OpContext* ctx) {
+    ctx->ts = 0;
+    ctx->rm = 0;
+    ctx->read_only = true;
+}
+
+// see `cache.h`.
+static void cache_upgrade_op(OpContext* ctx) {
+    if (ctx->read_only)
+        cache_begin_op(ctx);
+}
+
+// drop `block_no` from the file data of the running transaction, and return
+// whether it was there.
+// caller must hold `log.lock`.
+static bool remove_ordered(usize block_no) {
+    for (usize i = 0; i < log.num_ordered; i++) {
+        if (ordered_blocks[i] == block_no) {
+            ordered_blocks[i] = ordered_blocks[--log.num_ordered];
+            return true;
         }
-        header.block_no[i] = block->block_no;
-        if (i == header.num_blocks) {
-            header.num_blocks++;
-            block->pinned = 1;
+    }
+    return false;
+}
+
+// see `cache.h`.
+static void cache_sync_range(OpContext* ctx, Block* block, usize offset, usize num_bytes) {
+    if (!ctx) {
+        device_write(block);
+        return;
+    }
+    if (ctx->read_only)
+        PANIC("sync in read-only operation");
+    if (num_bytes == 0 || offset + num_bytes > BLOCK_SIZE)
+        PANIC("sync out of block");
+
+    acquire_spinlock(&log.lock);
+    if (__atomic_load_n(&log.outstanding, __ATOMIC_SEQ_CST) < 1)
+        PANIC("log_write outside of trans");
+    // committed log slots must stay intact until checkpoint, so a block
+    // updated again after its last commit gets a new entry.
+    usize i;
+    for (i = log.num_committed; i < log.num_entries; i++) {
+        if (entries[i].block_no == block->block_no)
+            break;
+    }
+    if (i < log.num_entries) {
+        entries[i].begin = (u16)MIN((usize)entries[i].begin, offset);
+        entries[i].end = (u16)MAX((usize)entries[i].end, offset + num_bytes);
+    } else {
+        if ((int)num_log_slots() >= log.mx)
+            PANIC("too big a transaction");
+        entries[i].block_no = block->block_no;
+        entries[i].begin = (u16)offset;
+        entries[i].end = (u16)(offset + num_bytes);
+        log.num_entries++;
+        set_pinned(block, true);
+        // the reserved slot now belongs to the transaction. A block that was
+        // file data earlier in this transaction hands over its slot.
+        if (!remove_ordered(block->block_no)) {
             if (ctx->rm > 0) {
                 ctx->rm--;
-                log.mu--;
             } else {
                 PANIC("OP_MAX_BLOCK exceeded");
             }
         }
-        release_spinlock(&log.lock);
-    } else
-        device_write(block);
+    }
+    release_spinlock(&log.lock);
+}
+
+// see `cache.h`.
+static void cache_sync(OpContext* ctx, Block* block) {
+    cache_sync_range(ctx, block, 0, BLOCK_SIZE);
 }
-void write_log() {
-    for (u32 tail = 0; tail < header.num_blocks; tail++) {
-        Block* from = cache_acquire(header.block_no[tail]);
-        Block* to = cache_acquire(sblock->log_start + tail + 1);
-        memmove(to->data, from->data, BLOCK_SIZE);
-        device_write(to);
-        cache_release(from);
-        cache_release(to);
+
+// see `cache.h`.
+static void cache_sync_data(OpContext* ctx, Block* block) {
+    if (!ctx || journal_mode == JOURNAL_FULL) {
+        cache_sync(ctx, block);
+        return;
     }
+    if (ctx->read_only)
+        PANIC("sync in read-only operation");
+
+    acquire_spinlock(&log.lock);
+    if (__atomic_load_n(&log.outstanding, __ATOMIC_SEQ_CST) < 1)
+        PANIC("log_write outside of trans");
+    // if the log holds a copy of the block, e.g. it was a directory block
+    // before, writing it in place would be undone by replay.
+    for (usize i = 0; i < log.num_entries; i++) {
+        if (entries[i].block_no == block->block_no) {
+            release_spinlock(&log.lock);
+            cache_sync(ctx, block);
+            return;
+        }
+    }
+    for (usize i = 0; i < log.num_ordered; i++) {
+        if (ordered_blocks[i] == block->block_no) {
+            release_spinlock(&log.lock);
+            return;
+        }
+    }
+    if ((int)num_log_slots() >= log.mx)
+        PANIC("too big a transaction");
+    ordered_blocks[log.num_ordered++] = block->block_no;
+    set_pinned(block, true);
+    if (ctx->rm > 0) {
+        ctx->rm--;
+    } else {
+        PANIC("OP_MAX_BLOCK exceeded");
+    }
+    release_spinlock(&log.lock);
 }
+
+// see `cache.h`.
+static void cache_set_journal_mode(JournalMode mode) {
+    acquire_spinlock(&log.lock);
+    if (__atomic_load_n(&log.outstanding, __ATOMIC_SEQ_CST) > 0 || is_dirty())
+        PANIC("journal mode changed while the log is in use");
+    journal_mode = mode;
+    release_spinlock(&log.lock);
+}
+
+// let replay start at `log.tail`, so that the log blocks before it can be
+// reused, and forget the checkpointed blocks.
+static void advance_log_tail() {
+    log_tail.tail.start = log.tail;
+    log_tail.tail.seq = log.tail_seq;
+    write_log_tail();
+    log.num_replayable = log.num_used;
+
+    usize n = log.num_checkpointed;
+    memmove(entries, entries + n, (log.num_entries - n) * sizeof(LogEntry));
+    log.num_entries -= n;
+    log.num_committed -= n;
+    log.num_checkpointed = 0;
+}
+
+// append the running transaction to the log, and return the number of log
+// blocks it takes after its descriptors. Blocks with few changed bytes are
+// packed as `LogDelta` records, and the rest are copied whole. The
+// descriptors and the log blocks go in one multi-block write, or two if the
+// log wraps around.
+static usize write_log() {
+    memset(&header, 0, sizeof(header));
+    memset(descriptors, 0, sizeof(descriptors));
+    u8** buffers = io_buffers + LOG_MAX_DESCRIPTORS;
+    usize n = 0;
+    for (usize i = log.num_committed; i < log.num_entries; i++) {
+        if (entries[i].end - entries[i].begin > LOG_DELTA_MAX_BYTES) {
+            io_blocks[n] = cache_acquire(entries[i].block_no);
+            buffers[n] = io_blocks[n]->data;
+            *trans_block_no(n) = (u32)entries[i].block_no;
+            n++;
+        }
+    }
+
+    usize num_whole = n, used = BLOCK_SIZE;
+    for (usize i = log.num_committed; i < log.num_entries; i++) {
+        usize num_bytes = entries[i].end - entries[i].begin;
+        if (num_bytes > LOG_DELTA_MAX_BYTES)
+            continue;
+        usize size = sizeof(LogDelta) + round_up(num_bytes, 8);
+        if (used + size > BLOCK_SIZE) {
+            buffers[n] = delta_buffers[n - num_whole];
+            memset(buffers[n], 0, BLOCK_SIZE);
+            *trans_block_no(n) = LOG_DELTA_BLOCK;
+            n++;
+            used = 0;
+        }
+        LogDelta* delta = (LogDelta*)(buffers[n - 1] + used);
+        delta->block_no = (u32)entries[i].block_no;
+        delta->offset = entries[i].begin;
+        delta->num_bytes = (u16)num_bytes;
+        Block* block = cache_acquire(entries[i].block_no);
+        memmove(delta + 1, block->data + entries[i].begin, num_bytes);
+        cache_release(block);
+        used += size;
+    }
+
+    usize d = LOG_NUM_DESCRIPTORS(n);
+    header.magic = LOG_MAGIC;
+    header.seq = log.record_seq++;
+    header.num_blocks = (u32)n;
+    header.num_descriptors = (u32)d;
+    u8** trans = buffers - d;
+    trans[0] = (u8*)&header;
+    for (usize i = 1; i < d; i++) {
+        trans[i] = (u8*)&descriptors[i - 1];
+    }
+    u32 sum = LOG_CHECKSUM_INIT;
+    for (usize i = 0; i < d + n; i++) {
+        sum = log_checksum(sum, trans[i]);
+    }
+    header.checksum = sum;
+
+    // replay must still find its way from `LogTail` to the new transaction.
+    if (log.num_replayable + d + n > log.size)
+        advance_log_tail();
+    usize first = MIN(d + n, log.size - log.head);
+    device_write_many(log_block_no(log.head), first, trans);
+    if (first < d + n)
+        device_write_many(log_block_no(0), d + n - first, trans + first);
+    log.head = (log.head + d + n) % log.size;
+    log.num_used += d + n;
+    log.num_replayable += d + n;
+
+    for (usize i = 0; i < num_whole; i++) {
+        cache_release(io_blocks[i]);
+    }
+    __atomic_fetch_add(&stats.num_log_writes, n, __ATOMIC_RELAXED);
+    return n;
+}
+
+// write `io_blocks[0..n]` back to disk, with one multi-block write for each
+// run of consecutive block numbers. They must be sorted by block number.
+static void write_sorted_blocks(usize n) {
+    for (usize i = 0, j; i < n; i = j) {
+        for (j = i + 1; j < n && io_blocks[j]->block_no == io_blocks[j - 1]->block_no + 1; j++) {
+        }
+        for (usize k = i; k < j; k++) {
+            io_buffers[k] = io_blocks[k]->data;
+        }
+        device_write_many(io_blocks[i]->block_no, j - i, io_buffers + i);
+    }
+}
+
+// sort `block_nos[0..n]` in place and drop duplicates, and return how many
+// distinct block numbers are left.
+static usize sort_distinct(usize* block_nos, usize n) {
+    usize m = 0;
+    for (usize i = 0; i < n; i++) {
+        usize block_no = block_nos[i], j = m;
+        while (j > 0 && block_nos[j - 1] > block_no) {
+            j--;
+        }
+        if (j > 0 && block_nos[j - 1] == block_no)
+            continue;
+        memmove(block_nos + j + 1, block_nos + j, (m - j) * sizeof(usize));
+        block_nos[j] = block_no;
+        m++;
+    }
+    return m;
+}
+
+// write the file data of the running transaction in place, before the
+// metadata referring to it is logged. `JOURNAL_ORDERED` only.
+static void write_ordered() {
+    usize n = sort_distinct(ordered_blocks, log.num_ordered);
+    for (usize i = 0; i < n; i++) {
+        io_blocks[i] = cache_acquire(ordered_blocks[i]);
+    }
+    write_sorted_blocks(n);
+    for (usize i = 0; i < n; i++) {
+        set_pinned(io_blocks[i], false);
+        cache_release(io_blocks[i]);
+    }
+
+    __atomic_fetch_sub(&log.reserved, log.num_ordered, __ATOMIC_SEQ_CST);
+    log.num_ordered = 0;
+    __atomic_fetch_add(&stats.num_data_writes, n, __ATOMIC_RELAXED);
+}
+
+// write committed blocks to their home locations from the block cache, and
+// truncate the log. A block logged by several transactions is written once,
+// and runs of consecutive blocks share one multi-block write.
+// it must only run when no atomic operation is outstanding, so that cached
+// blocks hold exactly the committed content.
+static void checkpoint() {
+    usize m = log.num_committed - log.num_checkpointed;
+    for (usize i = 0; i < m; i++) {
+        io_block_nos[i] = entries[log.num_checkpointed + i].block_no;
+    }
+    usize n = sort_distinct(io_block_nos, m);
+
+    for (usize i = 0; i < n; i++) {
+        io_blocks[i] = cache_acquire(io_block_nos[i]);
+    }
+    write_sorted_blocks(n);
+    for (usize i = 0; i < n; i++) {
+        set_pinned(io_blocks[i], false);
+        cache_release(io_blocks[i]);
+    }
+
+    // the transactions stay on disk for replay, until `advance_log_tail`.
+    __atomic_fetch_sub(&log.reserved, log.num_used, __ATOMIC_SEQ_CST);
+    log.num_used = 0;
+    log.tail = log.head;
+    log.tail_seq = log.record_seq;
+    log.num_checkpointed = log.num_committed;
+    __atomic_fetch_add(&stats.num_home_writes, n, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.num_checkpoints, 1, __ATOMIC_RELAXED);
+}
+
+// the running transaction has committed, so the blocks it freed can be
+// allocated again.
+// it must only run when no atomic operation is outstanding.
+static void release_held_blocks() {
+    acquire_spinlock(&free_space.lock);
+    for (usize i = 0; i < free_space.num_bitmap_blocks; i++) {
+        free_space.num_free[i] += free_space.num_held[i];
+        free_space.num_held[i] = 0;
+    }
+    release_spinlock(&free_space.lock);
+}
+
+// committed blocks stay pinned in the cache and are checkpointed lazily when
+// the committer is running. Otherwise every commit is checkpointed at once.
 void commit() {
-    if (header.num_blocks > 0) {
-        write_log();
-        write_header();
-        install_trans(0);
-        header.num_blocks = 0;
-        write_header();
+    u64 start = get_timestamp();
+    if (log.num_ordered > 0)
+        write_ordered();
+    if (log.num_entries > log.num_committed) {
+        usize n = write_log();
+        count_stat(commit_size[stat_bucket(n)], 1);
+        count_stat(commit_time[stat_bucket(ticks_to_us(get_timestamp() - start))], 1);
+        // descriptors take more log blocks, and packed blocks give back the
+        // ones they reserved.
+        __atomic_fetch_add(&log.reserved, LOG_NUM_DESCRIPTORS(n), __ATOMIC_SEQ_CST);
+        __atomic_fetch_sub(
+            &log.reserved, log.num_entries - log.num_committed - n, __ATOMIC_SEQ_CST);
+        log.num_committed = log.num_entries;
+        __atomic_fetch_add(&stats.num_commits, 1, __ATOMIC_RELAXED);
     }
+    release_held_blocks();
+    if (log.num_committed > log.num_checkpointed &&
+        (!log.has_committer || log.checkpoint_pending || (int)log.num_used >= log.mx / 2 ||
+         log.num_entries + (usize)log.mx > LOG_MAX_ENTRIES))
+        checkpoint();
+    // leave room in `entries` for the next transaction.
+    if (log.num_entries + (usize)log.mx > LOG_MAX_ENTRIES)
+        advance_log_tail();
 }
 // see `cache.h`.
 static void cache_end_op(OpContext* ctx) {
     // TODO
-    int do_commit = 0;
+    if (ctx->read_only)
+        return;
     acquire_spinlock(&log.lock);
-    log.outstanding--;
-    log.mu -= (int)ctx->rm;
     if (log.committing)
         PANIC("log committing");
-    if (log.outstanding == 0)
-        do_commit = 1, log.committing = 1;
-    else {
+    __atomic_fetch_sub(&log.reserved, ctx->rm, __ATOMIC_SEQ_CST);
+    if (log.has_committer) {
+        // the operation is folded into the running transaction. Durability is
+        // left to the committer and `barrier`.
+        if ((int)num_log_slots() >= log.mx / 2) {
+            log.commit_pending = log.checkpoint_pending = true;
+            update_blocked();
+        }
+        leave_op();
         wakeup(&log);
-        sleep(&log.outstanding, &log.lock);
+        release_spinlock(&log.lock);
+        return;
+    }
+
+    // without committer, the operation that finds no other running commits
+    // for all, and the others wait for it.
+    if (log.commit_pending || __atomic_sub_fetch(&log.outstanding, 1, __ATOMIC_SEQ_CST) > 0) {
+        if (log.commit_pending)
+            leave_op();
+        wakeup(&log);
+        while (log.done < ctx->ts) {
+            sleep(&log.outstanding, &log.lock);
+        }
+        release_spinlock(&log.lock);
+        return;
     }
+
+    // some operation may have begun without `log.lock` in the meantime.
+    log.commit_pending = true;
+    update_blocked();
+    while (__atomic_load_n(&log.outstanding, __ATOMIC_SEQ_CST) > 0) {
+        sleep(&log.commit_pending, &log.lock);
+    }
+    log.committing = 1;
+    log.commit_pending = false;
+    update_blocked();
     release_spinlock(&log.lock);
-    if (do_commit) {
+
+    commit();
+
+    // operations that begin once `blocked` is cleared must join the next
+    // transaction, see `try_begin_op`.
+    acquire_spinlock(&log.lock);
+    log.committing = 0;
+    log.done = log.seq++;
+    update_blocked();
+    wakeup(&log.outstanding);
+    wakeup(&log);
+    release_spinlock(&log.lock);
+}
+
+// see `cache.h`.
+static void cache_barrier() {
+    acquire_spinlock(&log.lock);
+    if (log.has_committer) {
+        // the running transaction contains every ended atomic operation, unless
+        // it is empty, in which case they are in the last one, which may be
+        // still committing.
+        usize target = log.seq;
+        if (!is_dirty() && __atomic_load_n(&log.outstanding, __ATOMIC_SEQ_CST) == 0 &&
+            !log.committing)
+            target = log.done;
+        if (log.done < target)
+            request_commit();
+        while (log.done < target) {
+            sleep(&log, &log.lock);
+        }
+    } else {
+        while (log.committing) {
+            sleep(&log, &log.lock);
+        }
+    }
+    release_spinlock(&log.lock);
+}
+
+// see `cache.h`.
+NO_RETURN void bcache_committer() {
+    acquire_spinlock(&log.lock);
+    log.has_committer = true;
+    for (;;) {
+        while (!log.commit_pending || __atomic_load_n(&log.outstanding, __ATOMIC_SEQ_CST) > 0) {
+            sleep(&log.commit_pending, &log.lock);
+        }
+
+        log.committing = 1;
+        update_blocked();
+        release_spinlock(&log.lock);
         commit();
         acquire_spinlock(&log.lock);
         log.committing = 0;
+        log.commit_pending = false;
+        log.checkpoint_pending = false;
+        log.num_ticks = 0;
+        log.done = log.seq++;
+        update_blocked();
         wakeup(&log.outstanding);
         wakeup(&log);
-        release_spinlock(&log.lock);
     }
 }
 
+// see `cache.h`.
+void bcache_tick() {
+    acquire_spinlock(&log.lock);
+    if (is_dirty()) {
+        if (++log.num_ticks >= COMMIT_TIMEOUT_TICKS)
+            request_commit();
+    } else if (log.num_committed > log.num_checkpointed) {
+        if (++log.num_ticks >= CHECKPOINT_TIMEOUT_TICKS)
+            request_checkpoint();
+    }
+    release_spinlock(&log.lock);
+}
+
+// see `cache.h`.
+static void cache_get_log_stats(LogStats* result) {
+    result->num_commits = __atomic_load_n(&stats.num_commits, __ATOMIC_RELAXED);
+    result->num_checkpoints = __atomic_load_n(&stats.num_checkpoints, __ATOMIC_RELAXED);
+    result->num_log_writes = __atomic_load_n(&stats.num_log_writes, __ATOMIC_RELAXED);
+    result->num_home_writes = __atomic_load_n(&stats.num_home_writes, __ATOMIC_RELAXED);
+    result->num_data_writes = __atomic_load_n(&stats.num_data_writes, __ATOMIC_RELAXED);
+}
+
+// see `cache.h`.
+static void cache_get_cache_stats(CacheStats* result) {
+    memset(result, 0, sizeof(CacheStats));
+    u64 wait_ticks = 0;
+    for (usize i = 0; i < NCPU; i++) {
+        CpuStats* cpu = &cpu_stats[i];
+        result->num_hits += __atomic_load_n(&cpu->num_hits, __ATOMIC_RELAXED);
+        result->num_misses += __atomic_load_n(&cpu->num_misses, __ATOMIC_RELAXED);
+        result->num_evictions += __atomic_load_n(&cpu->num_evictions, __ATOMIC_RELAXED);
+        result->num_ops += __atomic_load_n(&cpu->num_ops, __ATOMIC_RELAXED);
+        result->num_waits += __atomic_load_n(&cpu->num_waits, __ATOMIC_RELAXED);
+        wait_ticks += __atomic_load_n(&cpu->wait_ticks, __ATOMIC_RELAXED);
+        for (usize j = 0; j < CACHE_STATS_NUM_BUCKETS; j++) {
+            result->commit_size[j] += __atomic_load_n(&cpu->commit_size[j], __ATOMIC_RELAXED);
+            result->commit_time[j] += __atomic_load_n(&cpu->commit_time[j], __ATOMIC_RELAXED);
+        }
+    }
+    result->wait_time = ticks_to_us(wait_ticks);
+    result->num_cached = get_num_cached_blocks();
+    result->capacity = cache_get_capacity();
+    result->num_pinned = __atomic_load_n(&num_pinned, __ATOMIC_RELAXED);
+
+    acquire_spinlock(&log.lock);
+    result->num_dirty = log.num_entries - log.num_committed + log.num_ordered;
+    result->log_size = (usize)log.mx;
+    result->num_reserved = __atomic_load_n(&log.reserved, __ATOMIC_SEQ_CST);
+    release_spinlock(&log.lock);
+    cache_get_log_stats(&result->log);
+}
+
 // see `cache.h`.
 // hint: you can use `cache_acquire`/`cache_sync` to read/write blocks.
 usize BBLOCK(usize b, const SuperBlock* sb) {
     return b / BIT_PER_BLOCK + sb->bitmap_start;
 }
 void bzero(OpContext* ctx, u32 block_no) {
-    Block* bp = cache_acquire(block_no);
-    memset(bp->data, 0, BLOCK_SIZE);
+    Block* bp = cache_acquire_new(block_no);
     cache_sync(ctx, bp);
     cache_release(bp);
 }
+// take a free block, searching from `start` on. With `exact`, take `start`
+// only, and return 0 if it is not free. The block is zeroed if `zero`.
+static usize take_free_block(OpContext* ctx, usize start, bool exact, bool zero) {
+    // take a free bit of the first bitmap block with one, from `start` on.
+    // Concurrent callers never count on the same bit.
+    acquire_spinlock(&free_space.lock);
+    usize n = free_space.num_bitmap_blocks;
+    usize i = start / BIT_PER_BLOCK, k = 0;
+    while (k < n && free_space.num_free[i] == 0) {
+        if (exact) {
+            release_spinlock(&free_space.lock);
+            return 0;
+        }
+        i = (i + 1) % n;
+        k++;
+    }
+    if (k == n)
+        PANIC("cache_alloc: no free block");
+    free_space.num_free[i]--;
+    release_spinlock(&free_space.lock);
+
+    usize hint = k == 0 ? start % BIT_PER_BLOCK : 0;
+    Block* bp = cache_acquire(sblock->bitmap_start + i);
+    acquire_spinlock(&free_space.lock);
+    const u64* held = free_space.num_held[i] > 0 ? held_bitmaps[i] : NULL;
+    release_spinlock(&free_space.lock);
+    usize bi;
+    if (exact) {
+        bool used = (bp->data[hint / 8] >> (hint % 8)) & 1 ||
+                    (held && (held[hint / 64] >> (hint % 64)) & 1);
+        bi = used ? BIT_PER_BLOCK : hint;
+    } else {
+        bi = find_clear_bit((const u64*)bp->data, held, bitmap_block_bits(i), hint);
+        if (bi == BIT_PER_BLOCK)
+            PANIC("cache_alloc: free space index is corrupted");
+    }
+    if (bi == BIT_PER_BLOCK) {
+        cache_release(bp);
+        acquire_spinlock(&free_space.lock);
+        free_space.num_free[i]++;
+        release_spinlock(&free_space.lock);
+        return 0;
+    }
+    bp->data[bi / 8] |= (u8)(1 << (bi % 8));
+    cache_sync_range(ctx, bp, (usize)bi / 8, 1);
+    cache_release(bp);
+
+    usize b = i * BIT_PER_BLOCK + bi;
+    if (zero)
+        bzero(ctx, (u32)b);
+    return b;
+}
+
+// see `cache.h`.
 static usize cache_alloc(OpContext* ctx) {
     // TODO
-    u32 b, bi, m;
-    Block* bp = NULL;
-    for (b = 0; b < sblock->num_blocks; b += BIT_PER_BLOCK) {
-        bp = cache_acquire(BBLOCK((u32)b, sblock));
-        for (bi = 0; bi < BIT_PER_BLOCK && b + bi < sblock->num_blocks; bi++) {
-            m = (u32)(1 << (bi % 8));
-            if ((bp->data[bi / 8] & (u8)m) == 0) {
-                bp->data[bi / 8] |= (u8)m;
-                cache_sync(ctx, bp);
-                cache_release(bp);
-                bzero(ctx, b + bi);
-                return b + bi;
-            }
+    usize cursor = __atomic_load_n(&free_space.cursor, __ATOMIC_RELAXED);
+    usize b = take_free_block(ctx, cursor, false, true);
+    __atomic_store_n(&free_space.cursor, (b + 1) % sblock->num_blocks, __ATOMIC_RELAXED);
+    return b;
+}
+
+// allocate a block at `goal`, or start a new run, see `alloc_near`.
+static usize alloc_run(OpContext* ctx, usize goal, bool zero) {
+    if (goal > 0 && goal < sblock->num_blocks) {
+        usize b = take_free_block(ctx, goal, true, zero);
+        if (b)
+            return b;
+    }
+
+    usize cursor = __atomic_load_n(&free_space.cursor, __ATOMIC_RELAXED);
+    usize b = take_free_block(ctx, cursor, false, zero);
+    __atomic_store_n(
+        &free_space.cursor, (b + ALLOC_WINDOW_BLOCKS) % sblock->num_blocks, __ATOMIC_RELAXED);
+    return b;
+}
+
+// see `cache.h`.
+static usize cache_alloc_near(OpContext* ctx, usize goal) {
+    return alloc_run(ctx, goal, true);
+}
+
+// see `cache.h`.
+static usize cache_alloc_data(OpContext* ctx, usize goal) {
+    return alloc_run(ctx, goal, false);
+}
+
+// see `cache.h`.
+// hint: you can use `cache_acquire`/`cache_sync` to read/write blocks.
+static void cache_free_run(OpContext* ctx, usize block_no, usize num_blocks) {
+    usize end = block_no + num_blocks;
+    while (block_no < end) {
+        // the part of the run in one bitmap block.
+        usize n = MIN(end, (block_no / BIT_PER_BLOCK + 1) * BIT_PER_BLOCK) - block_no;
+        usize i = block_no / BIT_PER_BLOCK, first = block_no % BIT_PER_BLOCK;
+        Block* bp = cache_acquire(BBLOCK(block_no, sblock));
+        acquire_spinlock(&free_space.lock);
+        bool held = free_space.num_held[i] > 0;
+        release_spinlock(&free_space.lock);
+        if (!held)
+            memmove(held_bitmaps[i], bp->data, BLOCK_SIZE);
+        for (usize bi = first; bi < first + n; bi++) {
+            u8 m = (u8)(1 << (bi % 8));
+            if ((bp->data[bi / 8] & m) == 0)
+                PANIC("freeing free block");
+            bp->data[bi / 8] &= (u8)~m;
         }
+        cache_sync_range(ctx, bp, first / 8, (first + n - 1) / 8 - first / 8 + 1);
+
+        // the blocks are counted free once the transaction commits.
+        acquire_spinlock(&free_space.lock);
+        free_space.num_held[i] += (u16)n;
+        release_spinlock(&free_space.lock);
         cache_release(bp);
+        block_no += n;
     }
-    PANIC("cache_alloc: no free block");
 }
 
 // see `cache.h`.
-// hint: you can use `cache_acquire`/`cache_sync` to read/write blocks.
 static void cache_free(OpContext* ctx, usize block_no) {
-    // TODO
-    Block* bp;
-    int bi, m;
-    bp = cache_acquire(BBLOCK(block_no, sblock));
-    bi = block_no % BIT_PER_BLOCK;
-    m = 1 << (bi % 8);
-    if ((bp->data[bi / 8] & m) == 0) {
-        PANIC("freeing free block");
-    }
-    bp->data[bi / 8] &= ~m;
-    cache_sync(ctx, bp);
-    cache_release(bp);
+    cache_free_run(ctx, block_no, 1);
 }
 
 BlockCache bcache = {
     .get_num_cached_blocks = get_num_cached_blocks,
+    .set_capacity = cache_set_capacity,
+    .get_capacity = cache_get_capacity,
+    .set_policy = cache_set_policy,
     .acquire = cache_acquire,
+    .acquire_new = cache_acquire_new,
     .release = cache_release,
+    .prefetch = cache_prefetch,
     .begin_op = cache_begin_op,
+    .begin_op_sized = cache_begin_op_sized,
+    .begin_read_op = cache_begin_read_op,
+    .upgrade_op = cache_upgrade_op,
     .sync = cache_sync,
+    .sync_range = cache_sync_range,
+    .sync_data = cache_sync_data,
+    .set_journal_mode = cache_set_journal_mode,
     .end_op = cache_end_op,
+    .barrier = cache_barrier,
+    .get_log_stats = cache_get_log_stats,
+    .get_cache_stats = cache_get_cache_stats,
     .alloc = cache_alloc,
+    .alloc_near = cache_alloc_near,
+    .alloc_data = cache_alloc_data,
     .free = cache_free,
+    .free_run = cache_free_run,
 };
@@ -4,38 +4,123 @@
 #include <core/sleeplock.h>
 #include <fs/block_device.h>
 #include <fs/defines.h>
+#include <fs/stats.h>
 
 // maximum number of distinct blocks that one atomic operation can hold.
-#define OP_MAX_NUM_BLOCKS 10
+#define OP_MAX_NUM_BLOCKS 16
+
+// log slots reserved by creating an inode: the new inode, its bitmap and
+// inode blocks, the parent inode and up to three blocks of the parent
+// directory.
+#define OP_RESERVE_CREATE 7
+
+// log slots reserved by writing `n` bytes at `off` of a file: every touched
+// data block may also dirty one bitmap block, plus the inode and its extent
+// tree. A write of a few blocks adds at most one extent node per level, and
+// one more if the tree grows, each with its bitmap block. It also changes the
+// last leaf and the parent of the new nodes.
+#define OP_RESERVE_WRITE(off, n)                                                                   \
+    (2 * (((off) % BLOCK_SIZE + (n) + BLOCK_SIZE - 1) / BLOCK_SIZE) + 2 * EXTENT_MAX_DEPTH + 5)
+
+// changed byte ranges up to this size are logged as `LogDelta` records, several
+// to a log block, instead of the whole block.
+#define LOG_DELTA_MAX_BYTES (BLOCK_SIZE / 4)
+
+// blocks the log keeps track of between checkpoints. Packed records let it
+// hold more blocks than log slots.
+#define LOG_MAX_ENTRIES (LOG_MAX_SIZE * 2)
+
+// with the background committer running, the running transaction is committed
+// after it has been dirty for this many clock ticks.
+#define COMMIT_TIMEOUT_TICKS 2
+
+// with the background committer running, committed blocks are checkpointed
+// after the log has been idle for this many clock ticks.
+#define CHECKPOINT_TIMEOUT_TICKS 5
+
+// maximum number of blocks waiting for the background reader.
+#define READ_AHEAD_QUEUE_SIZE 64
+
+// maximum number of blocks in one multi-block read of the background reader.
+#define READ_AHEAD_BATCH 16
 
 // if the number of cached blocks is no less than this threshold, we can
-// evict some blocks in `acquire` to keep block cache small.
-#define EVICTION_THRESHOLD 20
+// evict some blocks in `acquire` to keep block cache small. It is the initial
+// capacity, see `set_capacity`.
+#define EVICTION_THRESHOLD 2048
+
+// the capacity grows by a block instead of evicting one as long as `kalloc`
+// has more free pages than this. When `kalloc` runs out, unused blocks are
+// dropped to give pages back and the capacity shrinks to what is left.
+#define CACHE_MIN_FREE_PAGES 1024
+
+// the block cache is split into shards by `block_no`. Each shard has its own
+// lock, replacement queues and hash buckets.
+#define CACHE_NUM_SHARDS 8
+
+// number of recently evicted blocks each shard remembers for `CACHE_POLICY_2Q`.
+#define CACHE_GHOST_SIZE (EVICTION_THRESHOLD / 2 / CACHE_NUM_SHARDS)
+
+// maximum number of bitmap blocks the free-space index of `alloc` covers.
+#define CACHE_MAX_BITMAP_BLOCKS 64
+
+// when `alloc_near` cannot continue a run at its goal, the new run gets this
+// many blocks to itself before other new runs start, so that files appended
+// to at the same time do not interleave.
+#define ALLOC_WINDOW_BLOCKS 16
+
+// replacement policies of the block cache, see `set_policy`.
+typedef enum {
+    CACHE_POLICY_LRU,  // evict the least recently used block first.
+    CACHE_POLICY_2Q,   // evict blocks used only once before the others.
+    CACHE_NUM_POLICIES,
+} CachePolicy;
+
+// each shard indexes its cached blocks by `block_no` in a hash table of one
+// page of buckets at first. The table doubles whenever the shard caches more
+// than `CACHE_HASH_LOAD` blocks per bucket, up to `CACHE_HASH_MAX_PAGES` pages,
+// so that hash chains stay short as the capacity grows.
+#define CACHE_HASH_LOAD      2
+#define CACHE_HASH_MAX_PAGES 128
+
+struct BufferSlab;
 
 // hint: `cache_test` only requires `block_no`, `valid` and `data` are present
 // in this struct. All other struct members can be customized by yourself.
 // for example, if you want to implement LFU strategy instead, you can add a
 // counter inside `Block` to maintain the number of times it was accessed.
 typedef struct {
-    // accesses to the following 4 members should be guarded by the lock
-    // of the block cache.
+    // accesses to the following 7 members should be guarded by the lock
+    // of the cache shard which `block_no` belongs to.
     usize block_no;
-    ListNode node;
-    bool acquired;  // is the block already acquired by some thread?
-    bool pinned;    // if a block is pinned, it should not be evicted from the
-                    // cache.
-    // FIXME
-    // u32 rc;
+    ListNode node;       // position in a replacement queue of its shard.
+    int queue;           // which replacement queue `node` is on.
+    usize stamp;         // the clock of its shard when it was allocated.
+    ListNode hash_node;  // position in the hash chain of `block_no`.
+    usize rc;            // number of threads holding or waiting for this block.
+    bool pinned;         // if a block is pinned, it should not be evicted from the
+                         // cache.
     SleepLock lock;  // this lock protects `valid` and `data`.
     bool valid;      // is the content of block loaded from disk?
-    u8 data[BLOCK_SIZE];
+    // `BLOCK_SIZE` bytes carved from a page of the cache, apart from this
+    // struct, so that the SD driver transfers to it directly.
+    u8* data;
+    struct BufferSlab* slab;  // the page `data` is carved from.
 } Block;
 
+// what the log protects, see `set_journal_mode`.
+typedef enum {
+    JOURNAL_FULL,     // file data is logged along with metadata.
+    JOURNAL_ORDERED,  // only metadata is logged. File data is written in place
+                      // before the transaction that refers to it commits.
+} JournalMode;
+
 // `OpContext` represents an atomic operation.
 // see `begin_op` and `end_op`.
 typedef struct {
     usize ts;  // the timestamp/identifier allocated by `begin_op`.
     usize rm;
+    bool read_only;  // begun by `begin_read_op` and not upgraded yet.
     // hint: you may want to add something else here.
 } OpContext;
 
@@ -45,14 +130,39 @@ typedef struct BlockCache {
     // or in other words, the number of allocated `Block` struct.
     usize (*get_num_cached_blocks)();
 
+    // change the number of blocks the cache tries to keep. Unused blocks
+    // beyond it are evicted right away, and the others once they are
+    // released and another block is needed. The capacity no longer grows
+    // with free memory afterwards, see `CACHE_MIN_FREE_PAGES`.
+    void (*set_capacity)(usize num_blocks);
+
+    // get the number of blocks the cache tries to keep.
+    usize (*get_capacity)();
+
+    // switch the replacement policy. Cached blocks stay cached.
+    // the default policy is `CACHE_POLICY_2Q`, so that a long sequential
+    // read does not flush the blocks in frequent use.
+    void (*set_policy)(CachePolicy policy);
+
     // read the content of block at `block_no` from disk, and lock the block.
     // return the pointer to the locked block.
     Block* (*acquire)(usize block_no);
 
+    // like `acquire`, but never read the block from disk. The content is
+    // zeroed instead, for a block whose old content does not matter, e.g. one
+    // just returned by `alloc_data`.
+    Block* (*acquire_new)(usize block_no);
+
     // unlock `block`.
     // NOTE: it does not need to write the block content back to disk.
     void (*release)(Block* block);
 
+    // hint that `block_no` will be acquired soon. It returns at once, and the
+    // block is read into cache by the background reader (see
+    // `bcache_reader`). Without the reader, or when its queue is full, the
+    // hint is dropped.
+    void (*prefetch)(usize block_no);
+
     // NOTES FOR ATOMIC OPERATIONS
     //
     // atomic operation has three states:
@@ -62,13 +172,34 @@ typedef struct BlockCache {
     //
     // `begin_op` creates a new running atomic operation.
     // `end_op` commits an atomic operation, and waits for it to be
-    // checkpointed.
+    // checkpointed. Once the background committer is running (see
+    // `bcache_committer`), `end_op` only folds the atomic operation into the
+    // running transaction, and `barrier` is the way to wait for durability.
+    // Committed blocks then stay pinned in the cache, and they are
+    // checkpointed in a batch when the log is half full or idle.
 
     // begin a new atomic operation and initialize `ctx`.
     // `OpContext` represents an outstanding atomic operation. You can mark the
     // end of atomic operation by `end_op`.
     void (*begin_op)(OpContext* ctx);
 
+    // like `begin_op`, but only reserves `num_blocks` log slots instead of
+    // `OP_MAX_NUM_BLOCKS`, so that more small operations fit into the log at
+    // the same time. `num_blocks` must not exceed `OP_MAX_NUM_BLOCKS`.
+    // See `OP_RESERVE_*` for the reservations of common operations.
+    void (*begin_op_sized)(OpContext* ctx, usize num_blocks);
+
+    // begin a read-only operation, e.g. a path lookup. It reserves no log
+    // space and never waits for commits, but `sync` panics until it is
+    // upgraded by `upgrade_op`. `end_op` still marks its end.
+    void (*begin_read_op)(OpContext* ctx);
+
+    // turn a read-only operation into a regular one, as `begin_op` does. It
+    // does nothing to a regular operation.
+    // NOTE: the caller must not hold any block lock, since it may wait for
+    // commits.
+    void (*upgrade_op)(OpContext* ctx);
+
     // synchronize the content of `block` to disk.
     // `ctx` can be NULL, which indicates this operation does not belong to any
     // atomic operation and it immediately writes block content back to disk.
@@ -78,13 +209,40 @@ typedef struct BlockCache {
     //
     // NOTE: the caller must hold the lock of `block`.
     // NOTE: if the number of blocks associated with `ctx` is larger than
-    // `OP_MAX_NUM_BLOCKS` after `sync`, `sync` should panic.
+    // its reservation after `sync`, `sync` should panic.
     void (*sync)(OpContext* ctx, Block* block);
 
+    // like `sync`, but only `block->data[offset..offset + num_bytes]` has
+    // changed. Small changes take a fraction of a log block, see
+    // `LOG_DELTA_MAX_BYTES`.
+    void (*sync_range)(OpContext* ctx, Block* block, usize offset, usize num_bytes);
+
+    // like `sync`, but for the content of a regular file. In `JOURNAL_ORDERED`
+    // mode, it is not logged but written to its home location right before
+    // the transaction commits, unless the log still holds an older copy of
+    // the block.
+    void (*sync_data)(OpContext* ctx, Block* block);
+
+    // choose what the log protects. It is a mount option, so call it before
+    // any atomic operation begins. The default is `JOURNAL_FULL`.
+    void (*set_journal_mode)(JournalMode mode);
+
     // end the atomic operation managed by `ctx`.
-    // it returns when all associated blocks are persisted to disk.
+    // it returns when all associated blocks are persisted to disk, or when
+    // the committer is running, as soon as they join the running transaction.
     void (*end_op)(OpContext* ctx);
 
+    // wait until all atomic operations ended before this call are persisted
+    // to disk. It is the durability point of `fsync` and `sync`.
+    void (*barrier)();
+
+    // read the counters of the logging layer.
+    void (*get_log_stats)(LogStats* stats);
+
+    // read the counters of the block cache, including those of the logging
+    // layer.
+    void (*get_cache_stats)(CacheStats* stats);
+
     // NOTES FOR BITMAP
     //
     // every block on disk has a bit in bitmap, including blocks inside bitmap!
@@ -100,10 +258,38 @@ typedef struct BlockCache {
     // NOTE: if there's no free block on disk, `alloc` should panic.
     usize (*alloc)(OpContext* ctx);
 
+    // like `alloc`, but prefer the block `goal`, e.g. the one right after
+    // the previous block of a file. If `goal` is 0 or not free, a new run of
+    // blocks is started instead, see `ALLOC_WINDOW_BLOCKS`.
+    usize (*alloc_near)(OpContext* ctx, usize goal);
+
+    // like `alloc_near`, but the block is not zeroed on disk. The caller must
+    // fill it with `acquire_new` and `sync` within the same atomic operation,
+    // so a file block is logged once, with its data.
+    usize (*alloc_data)(OpContext* ctx, usize goal);
+
     // mark block at `block_no` is free in bitmap.
+    // NOTE: the block is not allocated again until the transaction of `ctx`
+    // commits.
     void (*free)(OpContext* ctx, usize block_no);
+
+    // like `free`, but for the `num_blocks` blocks from `block_no` on. Each
+    // bitmap block is updated once for the whole run.
+    void (*free_run)(OpContext* ctx, usize block_no, usize num_blocks);
 } BlockCache;
 
 extern BlockCache bcache;
 
 void init_bcache(const SuperBlock* sblock, const BlockDevice* device);
+
+// body of the background committer thread. It batches ended atomic operations
+// into one transaction, and commits it when the log is half full, when
+// someone calls `barrier`, or after `COMMIT_TIMEOUT_TICKS` clock ticks. It
+// also checkpoints the log.
+NO_RETURN void bcache_committer();
+
+// body of the background reader thread, which serves `prefetch`.
+NO_RETURN void bcache_reader();
+
+// called on every clock tick to drive the commit and checkpoint timeouts.
+void bcache_tick();
@@ -8,14 +8,37 @@
 
 #define BLOCK_SIZE 512
 
-// maximum number of distinct block numbers can be recorded in the log header.
-#define LOG_MAX_SIZE ((BLOCK_SIZE - sizeof(usize)) / sizeof(usize))
+// maximum number of log blocks in one transaction, not counting its
+// descriptor blocks.
+#define LOG_MAX_SIZE 256
 
-#define INODE_NUM_DIRECT   12
-#define INODE_NUM_INDIRECT (BLOCK_SIZE / sizeof(u32))
-#define INODE_PER_BLOCK    (BLOCK_SIZE / sizeof(InodeEntry))
-#define INODE_MAX_BLOCKS   (INODE_NUM_DIRECT + INODE_NUM_INDIRECT)
-#define INODE_MAX_BYTES    (INODE_MAX_BLOCKS * BLOCK_SIZE)
+// block numbers recorded in the first descriptor block of a transaction, and
+// in each of the others.
+#define LOG_HEADER_NUM_BLOCKS     ((BLOCK_SIZE - 4 * sizeof(u32) - sizeof(u64)) / sizeof(u32))
+#define LOG_DESCRIPTOR_NUM_BLOCKS (BLOCK_SIZE / sizeof(u32))
+
+// descriptor blocks of a transaction with `n` log blocks.
+#define LOG_NUM_DESCRIPTORS(n)                                                                     \
+    (1 + ((n) > LOG_HEADER_NUM_BLOCKS                                                              \
+              ? ((n)-LOG_HEADER_NUM_BLOCKS + LOG_DESCRIPTOR_NUM_BLOCKS - 1) /                      \
+                    LOG_DESCRIPTOR_NUM_BLOCKS                                                      \
+              : 0))
+#define LOG_MAX_DESCRIPTORS LOG_NUM_DESCRIPTORS(LOG_MAX_SIZE)
+
+// `LogHeader.magic` of a transaction in the log.
+#define LOG_MAGIC 0x4c4f4721
+
+#define INODE_NUM_EXTENTS 4
+#define INODE_PER_BLOCK   (BLOCK_SIZE / sizeof(InodeEntry))
+
+// entries in one `ExtentNode`, and the maximum depth of an extent tree.
+#define EXTENT_NODE_SIZE ((BLOCK_SIZE - 2 * sizeof(u32)) / sizeof(Extent))
+#define EXTENT_MAX_DEPTH 2
+
+// every extent maps at least one block, so a full tree of the maximum depth
+// maps at least this many blocks.
+#define INODE_MAX_BLOCKS (INODE_NUM_EXTENTS * EXTENT_NODE_SIZE * EXTENT_NODE_SIZE)
+#define INODE_MAX_BYTES  (INODE_MAX_BLOCKS * BLOCK_SIZE)
 
 // the maximum length of file names, including trailing '\0'.
 #define FILE_NAME_MAX_LENGTH 14
@@ -45,21 +68,41 @@ typedef struct {
     u32 bitmap_start;    // the first block of bitmap area.
 } SuperBlock;
 
+// a run of `num_blocks` blocks of a file starting at block index `start`,
+// stored on disk from `block_no` on. In the index nodes of an extent tree,
+// `block_no` is the child node that maps the blocks from `start` on, up to
+// the `start` of the next entry, and `num_blocks` is unused.
+typedef struct {
+    u32 start;
+    u32 block_no;
+    u32 num_blocks;
+} Extent;
+
 // `type == INODE_INVALID` implies this inode is free.
+//
+// blocks of a file are mapped by a tree of extents, sorted by `start`. Its root
+// is `extents`. If `depth` is 0, they are the extents of the file. Otherwise
+// they point to `ExtentNode`s one level down, and the nodes `depth` levels down
+// hold the extents of the file.
 typedef struct dinode {
     InodeType type;
-    u16 major;                    // major device id, for INODE_DEVICE only.
-    u16 minor;                    // minor device id, for INODE_DEVICE only.
-    u16 num_links;                // number of hard links to this inode in the filesystem.
-    u32 num_bytes;                // number of bytes in the file, i.e. the size of file.
-    u32 addrs[INODE_NUM_DIRECT];  // direct addresses/block numbers.
-    u32 indirect;                 // the indirect address block.
+    u16 major;                          // major device id, for INODE_DEVICE only.
+    u16 minor;                          // minor device id, for INODE_DEVICE only.
+    u16 num_links;                      // number of hard links to this inode in the filesystem.
+    u32 num_bytes;                      // number of bytes in the file, i.e. the size of file.
+    u16 num_extents;                    // number of used entries in `extents`.
+    u16 depth;                          // depth of the extent tree.
+    Extent extents[INODE_NUM_EXTENTS];  // the root of the extent tree.
 } InodeEntry;
 
-// the block pointed by `InodeEntry.indirect`.
+// a non-root node of an extent tree. Its entries are extents if `depth` is
+// 0, or else nodes one level down.
 typedef struct {
-    u32 addrs[INODE_NUM_INDIRECT];
-} IndirectBlock;
+    u16 num_entries;
+    u16 depth;
+    u32 reserved;
+    Extent entries[EXTENT_NODE_SIZE];
+} ExtentNode;
 
 // directory entry. `inode_no == 0` implies this entry is free.
 typedef struct dirent {
@@ -67,10 +110,58 @@ typedef struct dirent {
     char name[FILE_NAME_MAX_LENGTH];
 } DirEntry;
 
+// the block number recorded for a log block that packs `LogDelta` records
+// instead of holding a whole block.
+#define LOG_DELTA_BLOCK ((u32)-1)
+
+// the first block of the logging area. The rest of it is a circular log, where
+// each transaction takes `num_descriptors` descriptor blocks, a `LogHeader`
+// and then `LogDescriptor`s, followed by `num_blocks` log blocks, wrapping
+// around at the end. Replay starts at `start`, and goes on as
+// long as it finds the next transaction intact. It is written only when the
+// log is about to wrap over transactions that replay would still visit.
 typedef struct {
-    usize num_blocks;
-    usize block_no[LOG_MAX_SIZE];
+    usize seq;    // sequence number of the transaction at `start`.
+    usize start;  // index of a log block after this one.
+} LogTail;
+
+// the commit record of a transaction, and its first descriptor block. It is
+// written together with the log blocks, and `checksum` tells whether all of
+// them made it to disk.
+typedef struct {
+    u32 magic;
+    u32 checksum;  // see `log_checksum`, computed with `checksum == 0`.
+    u64 seq;
+    u32 num_blocks;
+    u32 num_descriptors;  // `LOG_NUM_DESCRIPTORS(num_blocks)`.
+    u32 block_no[LOG_HEADER_NUM_BLOCKS];
 } LogHeader;
 
+// the descriptor blocks after `LogHeader` go on with the block numbers.
+typedef struct {
+    u32 block_no[LOG_DESCRIPTOR_NUM_BLOCKS];
+} LogDescriptor;
+
+// a changed byte range of a block in the log, followed by the bytes, padded to
+// 8 bytes. `num_bytes == 0` ends the records of a log block.
+typedef struct {
+    u32 block_no;
+    u16 offset;
+    u16 num_bytes;
+} LogDelta;
+
+#define LOG_CHECKSUM_INIT 2166136261u
+
+// checksum of a transaction: fold its descriptor blocks, then its log blocks
+// in order, into `sum`, starting from `LOG_CHECKSUM_INIT`. It is FNV-1a, one
+// 32-bit word at a time.
+static INLINE u32 log_checksum(u32 sum, const u8* data) {
+    const u32* words = (const u32*)data;
+    for (usize i = 0; i < BLOCK_SIZE / sizeof(u32); i++) {
+        sum = (sum ^ words[i]) * 16777619u;
+    }
+    return sum;
+}
+
 // mkfs only
 #define FSSIZE 1000  // Size of file system in blocks
\ No newline at end of file
@@ -70,7 +70,7 @@ void fileclose(struct file* f) {
         // pipeclose
     } else if (ff.type == FD_INODE) {
         OpContext ctx;
-        bcache.begin_op(&ctx);
+        bcache.begin_read_op(&ctx);
         inodes.put(&ctx, ff.ip);
         bcache.end_op(&ctx);
     }
@@ -113,16 +113,17 @@ isize filewrite(struct file* f, char* addr, isize n) {
     if (!f->writable)
         return -1;
     if (f->type == FD_INODE) {
-        usize mx = (OP_MAX_NUM_BLOCKS - 1 - 1 - 2) / 2 * 512;
+        // an unaligned chunk touches one more block.
+        usize mx = (OP_MAX_NUM_BLOCKS - OP_RESERVE_WRITE(0, 0) - 2) / 2 * BLOCK_SIZE;
         usize i = 0;
         while (i < n) {
             usize n1 = n - i;
             if (n1 > mx)
                 n1 = mx;
             OpContext ctx;
-            bcache.begin_op(&ctx);
+            bcache.begin_op_sized(&ctx, OP_RESERVE_WRITE(f->off, n1));
             inodes.lock(f->ip);
-            usize sz = inodes.write(&ctx, f->ip, addr + i, f->off, n);
+            usize sz = inodes.write(&ctx, f->ip, addr + i, f->off, n1);
             if (sz > 0)
                 f->off += sz;
             inodes.unlock(f->ip);
@@ -9,5 +9,8 @@ void init_filesystem() {
 
     const SuperBlock *sblock = get_super_block();
     init_bcache(sblock, &block_device);
+    // file data is not logged. Metadata never points to stale file content,
+    // and bulk writes go to disk only once.
+    bcache.set_journal_mode(JOURNAL_ORDERED);
     init_inodes(sblock, &bcache);
 }
@@ -1,3 +1,4 @@
+#include <aarch64/mmu.h>
 #include <common/string.h>
 #include <core/arena.h>
 #include <core/console.h>
@@ -6,15 +7,71 @@
 #include <core/sched.h>
 #include <fs/inode.h>
 
-// this lock mainly prevents concurrent access to inode list `head`, reference
-// count increment and decrement.
+// directories with more than `DIR_INDEX_MIN_BYTES` bytes of entries get a
+// hash index of their names in memory, built on their first lookup. It grows
+// with the directory up to `DIR_INDEX_MAX_BYTES`, beyond which the directory
+// is scanned a block at a time, as smaller ones are.
+#define DIR_INDEX_SLOTS_PER_PAGE (PAGE_SIZE / sizeof(u64))
+#define DIR_INDEX_MAX_PAGES      256
+#define DIR_INDEX_MAX_SLOTS      (DIR_INDEX_MAX_PAGES * DIR_INDEX_SLOTS_PER_PAGE)
+#define DIR_INDEX_MIN_BYTES      (2 * BLOCK_SIZE)
+#define DIR_INDEX_MAX_BYTES      (DIR_INDEX_MAX_SLOTS * 3 / 4 * sizeof(DirEntry))
+
+// the name index of a directory, in a page of its own. It is an open-addressed
+// hash table of `num_slots` slots in `pages`, each holding the 32-bit hash of
+// a name above the position of its entry plus one, or 0 if it is empty. The
+// table doubles before it gets more than 3/4 full.
+typedef struct DirIndex {
+    ListNode node;    // in `parked`, if its directory is not in memory.
+    usize inode_no;   // the directory, while it is parked.
+    usize num_slots;  // a power of two.
+    usize num_used;   // slots that are not empty.
+    u64* pages[DIR_INDEX_MAX_PAGES];
+} DirIndex;
+
+// this lock mainly prevents concurrent access to the inode hash table and the
+// unused inodes, reference count increment and decrement.
 static SpinLock lock;
-static ListNode head;
+static ListNode buckets[INODE_HASH_SIZE];
+
+// inodes with no references, kept for `inode_get` with their entries, the
+// most recently used first.
+static ListNode unused;
+static usize num_unused;
+
+// name indexes of directories whose inodes have left memory, the most recently
+// parked first, so that reading such a directory again does not scan it. The
+// directory cannot change in the meantime. Up to `DIR_INDEX_CACHE_SIZE` of
+// them are kept, and `kalloc` takes them back when it runs out of pages.
+// Protected by `lock`.
+static ListNode parked;
+static usize num_parked;
 
 static const SuperBlock* sblock;
 static const BlockCache* cache;
 static Arena arena;
 
+// a name in directory `parent`, and the inode it names, or 0 if there is no
+// such name. `parent` is 0 if the entry is unused.
+typedef struct {
+    ListNode node;       // in `dentry_lru`, the most recently used first.
+    ListNode hash_node;  // in `dentry_buckets`, if it is used.
+    usize parent;
+    usize inode_no;
+    char name[FILE_NAME_MAX_LENGTH];
+} Dentry;
+
+// the dentry cache, see `namex`. `dentry_lock` protects all of it.
+static SpinLock dentry_lock;
+static ListNode dentry_lru;
+static ListNode dentry_buckets[DENTRY_HASH_SIZE];
+static Dentry dentries[DENTRY_CACHE_SIZE];
+
+// return the hash bucket of `inode_no`.
+static INLINE ListNode* get_bucket(usize inode_no) {
+    return &buckets[inode_no % INODE_HASH_SIZE];
+}
+
 // return which block `inode_no` lives on.
 static INLINE usize to_block_no(usize inode_no) {
     return sblock->inode_start + (inode_no / (INODE_PER_BLOCK));
@@ -25,9 +82,206 @@ static INLINE InodeEntry* get_entry(Block* block, usize inode_no) {
     return ((InodeEntry*)block->data) + (inode_no % INODE_PER_BLOCK);
 }
 
-// return address array in indirect block.
-static INLINE u32* get_addrs(Block* block) {
-    return ((IndirectBlock*)block->data)->addrs;
+// return the extent tree node in `block`.
+static INLINE ExtentNode* get_node(Block* block) {
+    return (ExtentNode*)block->data;
+}
+
+// return the last of the `n` entries sorted by `start` that starts at or
+// before block `index`. `entries[0].start` must not be after `index`.
+static usize extent_search(const Extent* entries, usize n, usize index) {
+    usize lo = 0, hi = n;
+    while (hi - lo > 1) {
+        usize mid = (lo + hi) / 2;
+        if (entries[mid].start <= index)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// forget the extent cached in `inode`, see `extent_lookup`.
+static void reset_extent_cache(Inode* inode) {
+    memset(&inode->ext, 0, sizeof(inode->ext));
+    inode->ext_node = 0;
+    inode->ext_index = 0;
+    inode->ext_last = false;
+}
+
+// free `index` and its pages.
+static void dir_index_free(DirIndex* index) {
+    for (usize i = 0; i < index->num_slots / DIR_INDEX_SLOTS_PER_PAGE; i++) {
+        kfree(index->pages[i]);
+    }
+    kfree(index);
+}
+
+// allocate an empty name index of `num_slots` slots. Return NULL if `kalloc`
+// runs out.
+static DirIndex* dir_index_alloc(usize num_slots) {
+    DirIndex* index = kalloc();
+    if (!index)
+        return NULL;
+    init_list_node(&index->node);
+    index->inode_no = 0;
+    index->num_slots = 0;
+    index->num_used = 0;
+    for (usize i = 0; i < num_slots / DIR_INDEX_SLOTS_PER_PAGE; i++) {
+        index->pages[i] = kalloc();
+        if (!index->pages[i]) {
+            dir_index_free(index);
+            return NULL;
+        }
+        memset(index->pages[i], 0, PAGE_SIZE);
+        index->num_slots += DIR_INDEX_SLOTS_PER_PAGE;
+    }
+    return index;
+}
+
+// drop the name index of directory `inode`, and forget its free entries.
+static void reset_dir_index(Inode* inode) {
+    if (inode->dir_index)
+        dir_index_free(inode->dir_index);
+    inode->dir_index = NULL;
+    inode->dir_free = 0;
+}
+
+// keep the name index of `inode`, which is leaving memory, in `parked`.
+// return the parked index that has to go to make room, or NULL.
+// caller must hold `lock`.
+static DirIndex* park_dir_index(Inode* inode) {
+    DirIndex* index = inode->dir_index;
+    if (!index)
+        return NULL;
+    inode->dir_index = NULL;
+    index->inode_no = inode->inode_no;
+    merge_list(&parked, &index->node);
+    if (++num_parked <= DIR_INDEX_CACHE_SIZE)
+        return NULL;
+
+    DirIndex* oldest = container_of(parked.prev, DirIndex, node);
+    detach_from_list(&oldest->node);
+    num_parked--;
+    return oldest;
+}
+
+// take the name index of `inode_no` out of `parked`. Return NULL if there is
+// none.
+// caller must hold `lock`.
+static DirIndex* unpark_dir_index(usize inode_no) {
+    for (ListNode* p = parked.next; p != &parked; p = p->next) {
+        DirIndex* index = container_of(p, DirIndex, node);
+        if (index->inode_no == inode_no) {
+            detach_from_list(&index->node);
+            num_parked--;
+            return index;
+        }
+    }
+    return NULL;
+}
+
+// the reclaim hook of the inode layer, see `ReclaimHook`. It frees parked
+// name indexes, the least recently parked first.
+static usize dir_index_reclaim(usize num_pages) {
+    // the caller of `kalloc` may hold `lock`, e.g. in `inode_get`.
+    if (!try_acquire_spinlock(&lock))
+        return 0;
+    usize num_freed = 0;
+    while (num_freed < num_pages && num_parked > 0) {
+        DirIndex* index = container_of(parked.prev, DirIndex, node);
+        detach_from_list(&index->node);
+        num_parked--;
+        num_freed += index->num_slots / DIR_INDEX_SLOTS_PER_PAGE + 1;
+        dir_index_free(index);
+    }
+    release_spinlock(&lock);
+    return num_freed;
+}
+
+// return the 32-bit FNV-1a hash of a directory entry name.
+static u32 dir_hash(const char* name) {
+    u32 h = 2166136261u;
+    for (usize i = 0; i < FILE_NAME_MAX_LENGTH && name[i] != 0; i++) {
+        h ^= (u8)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// return the bucket of `name` in directory `parent`.
+static INLINE ListNode* dentry_bucket(usize parent, const char* name) {
+    return &dentry_buckets[(dir_hash(name) ^ parent * 0x9e3779b1u) % DENTRY_HASH_SIZE];
+}
+
+// find `name` in directory `parent`. Return NULL if it is not cached.
+// caller must hold `dentry_lock`.
+static Dentry* dentry_find(usize parent, const char* name) {
+    ListNode* bucket = dentry_bucket(parent, name);
+    for (ListNode* p = bucket->next; p != bucket; p = p->next) {
+        Dentry* d = container_of(p, Dentry, hash_node);
+        if (d->parent == parent && strncmp(d->name, name, FILE_NAME_MAX_LENGTH) == 0)
+            return d;
+    }
+    return NULL;
+}
+
+// drop dentry `d`, which makes it the next one to be reused.
+// caller must hold `dentry_lock`.
+static void dentry_drop(Dentry* d) {
+    d->parent = 0;
+    detach_from_list(&d->hash_node);
+    detach_from_list(&d->node);
+    merge_list(dentry_lru.prev, &d->node);
+}
+
+// look up `name` in directory `parent` in the dentry cache. If it is there,
+// return true and set `*inode_no`, which is 0 if the name does not exist.
+static bool dentry_lookup(usize parent, const char* name, usize* inode_no) {
+    acquire_spinlock(&dentry_lock);
+    Dentry* d = dentry_find(parent, name);
+    if (d) {
+        *inode_no = d->inode_no;
+        detach_from_list(&d->node);
+        merge_list(&dentry_lru, &d->node);
+    }
+    release_spinlock(&dentry_lock);
+    return d != NULL;
+}
+
+// remember that `name` in directory `parent` names `inode_no`, or nothing
+// if it is 0. The least recently used dentry makes room for it.
+static void dentry_add(usize parent, const char* name, usize inode_no) {
+    acquire_spinlock(&dentry_lock);
+    Dentry* d = dentry_find(parent, name);
+    if (!d) {
+        d = container_of(dentry_lru.prev, Dentry, node);
+        if (d->parent != 0)
+            detach_from_list(&d->hash_node);
+        d->parent = parent;
+        strncpy(d->name, name, FILE_NAME_MAX_LENGTH);
+        merge_list(dentry_bucket(parent, name), &d->hash_node);
+    }
+    d->inode_no = inode_no;
+    detach_from_list(&d->node);
+    merge_list(&dentry_lru, &d->node);
+    release_spinlock(&dentry_lock);
+}
+
+// forget `name` in directory `parent`, or every name in it if `name` is NULL.
+static void dentry_forget(usize parent, const char* name) {
+    acquire_spinlock(&dentry_lock);
+    if (name) {
+        Dentry* d = dentry_find(parent, name);
+        if (d)
+            dentry_drop(d);
+    } else {
+        for (usize i = 0; i < DENTRY_CACHE_SIZE; i++) {
+            if (dentries[i].parent == parent)
+                dentry_drop(&dentries[i]);
+        }
+    }
+    release_spinlock(&dentry_lock);
 }
 
 // initialize inode tree.
@@ -35,7 +289,25 @@ void init_inodes(const SuperBlock* _sblock, const BlockCache* _cache) {
     ArenaPageAllocator allocator = {.allocate = kalloc, .free = kfree};
 
     init_spinlock(&lock, "inode tree");
-    init_list_node(&head);
+    for (usize i = 0; i < INODE_HASH_SIZE; i++) {
+        init_list_node(&buckets[i]);
+    }
+    init_list_node(&unused);
+    num_unused = 0;
+    init_list_node(&parked);
+    num_parked = 0;
+    register_reclaim_hook(dir_index_reclaim);
+    init_spinlock(&dentry_lock, "dentry cache");
+    init_list_node(&dentry_lru);
+    for (usize i = 0; i < DENTRY_HASH_SIZE; i++) {
+        init_list_node(&dentry_buckets[i]);
+    }
+    for (usize i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        dentries[i].parent = 0;
+        init_list_node(&dentries[i].node);
+        init_list_node(&dentries[i].hash_node);
+        merge_list(dentry_lru.prev, &dentries[i].node);
+    }
     sblock = _sblock;
     cache = _cache;
     init_arena(&arena, sizeof(Inode), allocator);
@@ -51,8 +323,16 @@ static void init_inode(Inode* inode) {
     init_spinlock(&inode->lock, "Inode");
     init_rc(&inode->rc);
     init_list_node(&inode->node);
+    init_list_node(&inode->hash_node);
     inode->inode_no = 0;
     inode->valid = false;
+    inode->ra_next = 0;
+    inode->ra_window = 0;
+    inode->ra_end = 0;
+    inode->alloc_goal = 0;
+    reset_extent_cache(inode);
+    inode->dir_index = NULL;
+    inode->dir_free = 0;
 }
 
 // see `inode.h`.
@@ -67,7 +347,7 @@ static usize inode_alloc(OpContext* ctx, InodeType type) {
         if (dip->type == 0) {
             memset(dip, 0, sizeof(*dip));
             dip->type = type;
-            cache->sync(ctx, bp);
+            cache->sync_range(ctx, bp, (usize)((u8*)dip - bp->data), sizeof(*dip));
             cache->release(bp);
             // return (inode_get(inum))->inode_no;
             return inum;
@@ -103,9 +383,10 @@ static void inode_sync(OpContext* ctx, Inode* inode, bool do_write) {
         dip->minor = inode->entry.minor;
         dip->num_links = inode->entry.num_links;
         dip->num_bytes = inode->entry.num_bytes;
-        dip->indirect = inode->entry.indirect;
-        memmove(dip->addrs, inode->entry.addrs, sizeof(inode->entry.addrs));
-        cache->sync(ctx, bp);
+        dip->num_extents = inode->entry.num_extents;
+        dip->depth = inode->entry.depth;
+        memmove(dip->extents, inode->entry.extents, sizeof(inode->entry.extents));
+        cache->sync_range(ctx, bp, (usize)((u8*)dip - bp->data), sizeof(*dip));
 
     } else if (!inode->valid) {
         inode->valid = true;
@@ -114,8 +395,9 @@ static void inode_sync(OpContext* ctx, Inode* inode, bool do_write) {
         inode->entry.minor = dip->minor;
         inode->entry.num_links = dip->num_links;
         inode->entry.num_bytes = dip->num_bytes;
-        inode->entry.indirect = dip->indirect;
-        memmove(inode->entry.addrs, dip->addrs, sizeof(inode->entry.addrs));
+        inode->entry.num_extents = dip->num_extents;
+        inode->entry.depth = dip->depth;
+        memmove(inode->entry.extents, dip->extents, sizeof(inode->entry.extents));
     }
     cache->release(bp);
 }
@@ -125,66 +407,66 @@ static Inode* inode_get(usize inode_no) {
     assert(inode_no > 0);
     assert(inode_no < sblock->num_inodes);
     acquire_spinlock(&lock);
-    // TODO
-    ListNode *p = head.next, *empty = 0;
-    Inode* ip;
-    while (p != &head) {
-        if (!p) {
-            PANIC("empty p");
-        }
-        ip = container_of(p, Inode, node);
-        if (ip->rc.count > 0 && ip->inode_no == inode_no) {
-            increment_rc(&(ip->rc));
+    ListNode* bucket = get_bucket(inode_no);
+    for (ListNode* p = bucket->next; p != bucket; p = p->next) {
+        Inode* ip = container_of(p, Inode, hash_node);
+        if (ip->inode_no == inode_no) {
+            // an unused inode still has its entry.
+            if (ip->rc.count == 0) {
+                detach_from_list(&ip->node);
+                num_unused--;
+            }
+            increment_rc(&ip->rc);
             release_spinlock(&lock);
             return ip;
         }
-        if (empty == 0 && ip->rc.count == 0) {
-            empty = &(ip->node);
-        }
-        p = p->next;
-    }
-    if (empty) {
-        ip = container_of(empty, Inode, node);
-    } else {
-        ip = (Inode*)alloc_object(&arena);
-        init_inode(ip);
-        merge_list(&head, &(ip->node));
     }
 
+    Inode* ip = (Inode*)alloc_object(&arena);
+    init_inode(ip);
     ip->inode_no = inode_no;
-    increment_rc(&(ip->rc));
-    ip->valid = 0;
+    ip->dir_index = unpark_dir_index(inode_no);
+    increment_rc(&ip->rc);
+    merge_list(bucket, &ip->hash_node);
     inode_lock(ip);
     inode_sync(NULL, ip, false);
     inode_unlock(ip);
 
     release_spinlock(&lock);
     return ip;
+}
 
-    return NULL;
+// free the blocks mapped by `n` entries of an extent tree `depth` levels above
+// the extents, and the nodes below them. Each node is read once, and each
+// extent is freed as one run.
+static void extent_free(OpContext* ctx, const Extent* entries, usize n, usize depth) {
+    for (usize i = 0; i < n; i++) {
+        const Extent* e = &entries[i];
+        if (depth == 0) {
+            cache->free_run(ctx, e->block_no, e->num_blocks);
+            continue;
+        }
+        Block* block = cache->acquire(e->block_no);
+        ExtentNode* node = get_node(block);
+        extent_free(ctx, node->entries, node->num_entries, depth - 1);
+        cache->release(block);
+        cache->free(ctx, e->block_no);
+    }
 }
+
 // see `inode.h`.
 static void inode_clear(OpContext* ctx, Inode* inode) {
     InodeEntry* entry = &inode->entry;
-    for (int i = 0; i < INODE_NUM_DIRECT; i++) {
-        if (entry->addrs[i]) {
-            cache->free(ctx, entry->addrs[i]);
-            entry->addrs[i] = 0;
-        }
-    }
-    if (entry->indirect) {
-        Block* bp = cache->acquire(entry->indirect);
-        u32* a = (void*)(bp->data);
-        for (u32 i = 0; i < INODE_NUM_INDIRECT; i++) {
-            if (a[i]) {
-                cache->free(ctx, a[i]);
-            }
-        }
-        cache->release(bp);
-        cache->free(ctx, entry->indirect);
-        entry->indirect = 0;
-    }
+    extent_free(ctx, entry->extents, entry->num_extents, entry->depth);
+    memset(entry->extents, 0, sizeof(entry->extents));
+    entry->num_extents = 0;
+    entry->depth = 0;
     entry->num_bytes = 0;
+    inode->alloc_goal = 0;
+    reset_extent_cache(inode);
+    reset_dir_index(inode);
+    if (entry->type == INODE_DIRECTORY)
+        dentry_forget(inode->inode_no, NULL);
     inode_sync(ctx, inode, true);
     // TODO
 }
@@ -206,6 +488,13 @@ static void inode_put(OpContext* ctx, Inode* inode) {
     // inode->entry.num_links);
     if (inode->rc.count == 1 && inode->valid && inode->entry.num_links == 0) {
         // printf("hello\n");
+        // freeing the inode needs a regular atomic operation.
+        if (ctx->read_only) {
+            release_spinlock(&lock);
+            cache->upgrade_op(ctx);
+            inode_put(ctx, inode);
+            return;
+        }
 
         inode_lock(inode);
         release_spinlock(&lock);
@@ -218,15 +507,203 @@ static void inode_put(OpContext* ctx, Inode* inode) {
         inode_unlock(inode);
         acquire_spinlock(&lock);
 
-        ListNode* node = &(inode->node);
-        node = detach_from_list(node);
+        detach_from_list(&inode->hash_node);
         decrement_rc(&(inode->rc));
         release_spinlock(&lock);
+        reset_dir_index(inode);
         free_object(inode);
         return;
     }
-    decrement_rc(&(inode->rc));
+
+    // the last reference keeps the inode cached, and makes the least recently
+    // used unused inode go if there are too many. Its name index stays.
+    Inode* victim = NULL;
+    DirIndex* dropped = NULL;
+    if (decrement_rc(&inode->rc)) {
+        merge_list(&unused, &inode->node);
+        if (++num_unused > INODE_CACHE_SIZE) {
+            victim = container_of(unused.prev, Inode, node);
+            detach_from_list(&victim->node);
+            detach_from_list(&victim->hash_node);
+            num_unused--;
+            dropped = park_dir_index(victim);
+        }
+    }
     release_spinlock(&lock);
+    if (dropped)
+        dir_index_free(dropped);
+    if (victim)
+        free_object(victim);
+}
+
+// allocate a block for `inode`, right after `prev` if it is not 0, or else
+// where the last allocation of `inode` ended, so that its blocks form
+// contiguous runs on disk. A data block is not zeroed, see `inode_write`.
+static usize inode_alloc_block(OpContext* ctx, Inode* inode, usize prev, bool data) {
+    usize goal = prev ? prev + 1 : inode->alloc_goal;
+    usize b = data ? cache->alloc_data(ctx, goal) : cache->alloc_near(ctx, goal);
+    inode->alloc_goal = b + 1;
+    return b;
+}
+
+// return the block number of the `index`-th block of `inode`, or 0 if it is
+// not mapped yet. The extent looked at last is cached in `inode`, and blocks in
+// it, or past the end of the file, are found without reading the tree.
+static usize extent_lookup(Inode* inode, usize index) {
+    InodeEntry* entry = &inode->entry;
+    Extent* ext = &inode->ext;
+    if (index - ext->start < ext->num_blocks)
+        return ext->block_no + (index - ext->start);
+    if (inode->ext_last && index >= ext->start)
+        return 0;
+    if (entry->num_extents == 0) {
+        reset_extent_cache(inode);
+        inode->ext_last = true;
+        return 0;
+    }
+
+    Block* block = NULL;
+    usize i = extent_search(entry->extents, entry->num_extents, index);
+    const Extent* e = &entry->extents[i];
+    bool last = i + 1 == entry->num_extents;
+    usize node_no = 0;
+    for (usize depth = entry->depth; depth > 0; depth--) {
+        node_no = e->block_no;
+        Block* child = cache->acquire(node_no);
+        if (block)
+            cache->release(block);
+        block = child;
+        ExtentNode* node = get_node(block);
+        i = extent_search(node->entries, node->num_entries, index);
+        e = &node->entries[i];
+        last = last && i + 1 == node->num_entries;
+    }
+    *ext = *e;
+    inode->ext_node = node_no;
+    inode->ext_index = i;
+    inode->ext_last = last;
+    if (block)
+        cache->release(block);
+
+    return index - ext->start < ext->num_blocks ? ext->block_no + (index - ext->start) : 0;
+}
+
+// allocate a new extent tree node of `depth` for `inode`, holding `n` entries.
+static usize extent_new_node(OpContext* ctx,
+                             Inode* inode,
+                             usize depth,
+                             const Extent* entries,
+                             usize n) {
+    usize block_no = inode_alloc_block(ctx, inode, 0, false);
+    Block* block = cache->acquire(block_no);
+    ExtentNode* node = get_node(block);
+    memset(node, 0, sizeof(*node));
+    node->num_entries = (u16)n;
+    node->depth = (u16)depth;
+    memmove(node->entries, entries, n * sizeof(Extent));
+    cache->sync(ctx, block);
+    cache->release(block);
+    return block_no;
+}
+
+// add the extent `ext` after the last one of `inode`. It goes to the last
+// leaf, and if that is full, to a new chain of nodes under the lowest node on
+// the rightmost path that has room. If none has, the root moves down into a
+// new node and the tree grows by one level. The new extent is cached.
+static void extent_insert(OpContext* ctx, Inode* inode, Extent ext) {
+    InodeEntry* entry = &inode->entry;
+
+    // the rightmost path. Level 0 is the inode itself.
+    Block* path[EXTENT_MAX_DEPTH + 1] = {NULL};
+    usize node_no[EXTENT_MAX_DEPTH + 1] = {0};
+    Extent* entries[EXTENT_MAX_DEPTH + 1];
+    u16* num_entries[EXTENT_MAX_DEPTH + 1];
+    usize capacity[EXTENT_MAX_DEPTH + 1];
+    entries[0] = entry->extents;
+    num_entries[0] = &entry->num_extents;
+    capacity[0] = INODE_NUM_EXTENTS;
+    usize depth = entry->depth;
+    for (usize i = 1; i <= depth; i++) {
+        node_no[i] = entries[i - 1][*num_entries[i - 1] - 1].block_no;
+        path[i] = cache->acquire(node_no[i]);
+        ExtentNode* node = get_node(path[i]);
+        entries[i] = node->entries;
+        num_entries[i] = &node->num_entries;
+        capacity[i] = EXTENT_NODE_SIZE;
+    }
+
+    // the lowest level with room.
+    usize level = depth;
+    while (level > 0 && *num_entries[level] == capacity[level])
+        level--;
+    if (*num_entries[level] == capacity[level]) {
+        if (depth == EXTENT_MAX_DEPTH)
+            PANIC("extent tree is full");
+        Extent root = {.start = 0};
+        root.block_no = (u32)extent_new_node(ctx, inode, depth, entry->extents, entry->num_extents);
+        memset(entry->extents, 0, sizeof(entry->extents));
+        entry->extents[0] = root;
+        entry->num_extents = 1;
+        entry->depth = (u16)++depth;
+    }
+
+    // build the new chain bottom-up, then link it to `level`.
+    Extent e = ext;
+    inode->ext_node = level < depth ? 0 : node_no[level];
+    inode->ext_index = level < depth ? 0 : *num_entries[level];
+    for (usize i = depth; i > level; i--) {
+        e.block_no = (u32)extent_new_node(ctx, inode, depth - i, &e, 1);
+        e.num_blocks = 0;
+        if (i == depth)
+            inode->ext_node = e.block_no;
+    }
+    entries[level][(*num_entries[level])++] = e;
+    if (level > 0) {
+        Block* block = path[level];
+        cache->sync_range(ctx, block, 0, sizeof(u16));
+        cache->sync_range(ctx, block,
+                          (usize)((u8*)&entries[level][*num_entries[level] - 1] - block->data),
+                          sizeof(Extent));
+    }
+    inode->ext = ext;
+    inode->ext_last = true;
+
+    for (usize i = 1; i <= EXTENT_MAX_DEPTH; i++) {
+        if (path[i])
+            cache->release(path[i]);
+    }
+}
+
+// map the `index`-th block of `inode`, which must be the block right after
+// the last mapped one, to a newly allocated block. The last extent grows if
+// the new block follows it on disk, which only takes its cached leaf.
+// Otherwise a new extent is added.
+static usize extent_append(OpContext* ctx, Inode* inode, usize index) {
+    Extent* ext = &inode->ext;
+    if (!inode->ext_last)
+        extent_lookup(inode, index);
+    if (!inode->ext_last || index != ext->start + ext->num_blocks)
+        PANIC("offset out of bound");
+
+    usize prev = ext->num_blocks > 0 ? ext->block_no + ext->num_blocks - 1 : 0;
+    usize addr = inode_alloc_block(ctx, inode, prev, true);
+    if (ext->num_blocks == 0 || addr != prev + 1) {
+        Extent e = {.start = (u32)index, .block_no = (u32)addr, .num_blocks = 1};
+        extent_insert(ctx, inode, e);
+        return addr;
+    }
+
+    ext->num_blocks++;
+    if (inode->ext_node == 0) {
+        inode->entry.extents[inode->ext_index] = *ext;
+    } else {
+        Block* block = cache->acquire(inode->ext_node);
+        Extent* e = &get_node(block)->entries[inode->ext_index];
+        *e = *ext;
+        cache->sync_range(ctx, block, (usize)((u8*)e - block->data), sizeof(*e));
+        cache->release(block);
+    }
+    return addr;
 }
 
 // this function is private to inode layer, because it can allocate block
@@ -234,7 +711,9 @@ static void inode_put(OpContext* ctx, Inode* inode) {
 //
 // retrieve the block in `inode` where offset lives. If the block is not
 // allocated, `inode_map` will allocate a new block and update `inode`, at
-// which time, `*modified` will be set to true.
+// which time, `*modified` will be set to true. The new block is not zeroed,
+// so the caller must overwrite it in the same atomic operation. Blocks are
+// only ever allocated at the end of the file.
 // the block number is returned.
 //
 // NOTE: caller must hold the lock of `inode`.
@@ -242,38 +721,45 @@ static usize inode_map(OpContext* ctx,
                        Inode* inode,
                        usize offset,
                        bool* modified) {
-    InodeEntry* entry = &inode->entry;
+    usize addr = extent_lookup(inode, offset);
+    *modified = addr == 0;
+    if (addr == 0)
+        addr = extent_append(ctx, inode, offset);
+    return addr;
+}
 
-    // TODO
-    u32 addr;
-    *modified = false;
-    if (offset < INODE_NUM_DIRECT) {
-        if ((addr = entry->addrs[offset]) == 0) {
-            entry->addrs[offset] = (cache->alloc(ctx));
-            addr = entry->addrs[offset];
-            *modified = true;
-        }
+// see `inode.h`.
+// return the block number of the `index`-th block of `inode`, or 0 if it is
+// not allocated. Unlike `inode_map`, it never allocates.
+static usize inode_peek(Inode* inode, usize index) {
+    return extent_lookup(inode, index);
+}
 
-        return addr;
+// called before `inode_read` reads blocks `first` to `last`. If the read
+// continues the previous one, the window grows and the blocks following
+// `last` are prefetched. A random read resets the window.
+static void read_ahead(Inode* inode, usize first, usize last) {
+    if (first == inode->ra_next) {
+        inode->ra_window = MIN(MAX(inode->ra_window * 2, (usize)READ_AHEAD_MIN_WINDOW),
+                               (usize)READ_AHEAD_MAX_WINDOW);
+    } else if (first + 1 != inode->ra_next) {
+        // reading the rest of the last block is still sequential.
+        inode->ra_window = 0;
+        inode->ra_end = 0;
     }
-    offset -= INODE_NUM_DIRECT;
-    if (offset < INODE_NUM_INDIRECT) {
-        if ((addr = (entry->indirect)) == 0) {
-            addr = entry->indirect = cache->alloc(ctx);
-        }
-        Block* bp = cache->acquire(addr);
-        u32* a = (void*)bp->data;
-        if ((addr = a[offset]) == 0) {
-            addr = a[offset] = cache->alloc(ctx);
-            *modified = true;
-            cache->sync(ctx, bp);
-        }
-        // printf("addr:%x|a0:%x|a1:%x\n", addr, a[0], a[1]);
-        cache->release(bp);
-        return addr;
+    inode->ra_next = last + 1;
+    if (inode->ra_window == 0)
+        return;
+
+    usize num_blocks = (inode->entry.num_bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    usize begin = MAX(inode->ra_end, last + 1);
+    usize end = MIN(last + 1 + inode->ra_window, num_blocks);
+    for (usize i = begin; i < end; i++) {
+        usize block_no = inode_peek(inode, i);
+        if (block_no != 0)
+            cache->prefetch(block_no);
     }
-    PANIC("offset out of bound");
-    return 0;
+    inode->ra_end = MAX(inode->ra_end, end);
 }
 
 // see `inode.h`.
@@ -290,6 +776,8 @@ static usize inode_read(Inode* inode, u8* dest, usize offset, usize count) {
     assert(offset <= entry->num_bytes);
     assert(end <= entry->num_bytes);
     assert(offset <= end);
+    if (count > 0)
+        read_ahead(inode, offset / BLOCK_SIZE, (end - 1) / BLOCK_SIZE);
 
     u32 tot, m;
     bool mdfd;
@@ -321,45 +809,216 @@ static usize inode_write(OpContext* ctx,
     assert(offset <= end);
 
     u32 tot, m;
-    bool mdfd;
+    bool mdfd, mapped = false;
     Block* bp;
     for (tot = 0; tot < count; tot += m, offset += m, src += m) {
-        bp = cache->acquire(inode_map(ctx, inode, offset / BLOCK_SIZE, &mdfd));
+        // a new block has nothing worth reading, and the rest of it beyond
+        // the new data stays zero.
+        usize block_no = inode_map(ctx, inode, offset / BLOCK_SIZE, &mdfd);
+        bp = mdfd ? cache->acquire_new(block_no) : cache->acquire(block_no);
+        mapped |= mdfd;
         m = MIN(count - tot, BLOCK_SIZE - offset % BLOCK_SIZE);
         memmove(bp->data + offset % BLOCK_SIZE, src, m);
-        cache->sync(ctx, bp);
+        // directory entries are metadata, so only regular files may bypass the
+        // log. A new block is logged whole, since it is not zeroed on disk.
+        if (inode->entry.type == INODE_REGULAR)
+            cache->sync_data(ctx, bp);
+        else if (mdfd)
+            cache->sync(ctx, bp);
+        else
+            cache->sync_range(ctx, bp, offset % BLOCK_SIZE, m);
         cache->release(bp);
     }
-    if (count > 0 && offset > inode->entry.num_bytes) {
-        inode->entry.num_bytes = offset;
+    // new blocks may have changed the extents in the inode.
+    if (mapped || offset > inode->entry.num_bytes) {
+        inode->entry.num_bytes = (u32)MAX(inode->entry.num_bytes, offset);
         inode_sync(ctx, inode, true);
     }
 
     return count;
 }
 
+// return slot `i` of `index`.
+static INLINE u64* dir_index_slot(DirIndex* index, usize i) {
+    return &index->pages[i / DIR_INDEX_SLOTS_PER_PAGE][i % DIR_INDEX_SLOTS_PER_PAGE];
+}
+
+// return the index slot of the entry at `offset` with a name of `hash`.
+static INLINE u64 dir_slot(u32 hash, usize offset) {
+    return (u64)hash << 32 | (u64)(offset / sizeof(DirEntry) + 1);
+}
+
+// put `slot` in the first empty slot of `index` from where its hash points.
+static void dir_index_put(DirIndex* index, u64 slot) {
+    usize mask = index->num_slots - 1;
+    usize i = (slot >> 32) & mask;
+    while (*dir_index_slot(index, i) != 0)
+        i = (i + 1) & mask;
+    *dir_index_slot(index, i) = slot;
+    index->num_used++;
+}
+
+// add the entry at `offset` with a name of `hash` to the index of `inode`.
+// The index doubles first if it would get more than 3/4 full, or is dropped
+// if it cannot.
+static void dir_index_add(Inode* inode, u32 hash, usize offset) {
+    DirIndex* index = inode->dir_index;
+    if ((index->num_used + 1) * 4 > index->num_slots * 3) {
+        DirIndex* larger = NULL;
+        if (index->num_slots < DIR_INDEX_MAX_SLOTS)
+            larger = dir_index_alloc(index->num_slots * 2);
+        if (!larger) {
+            reset_dir_index(inode);
+            return;
+        }
+        for (usize i = 0; i < index->num_slots; i++) {
+            u64 slot = *dir_index_slot(index, i);
+            if (slot != 0)
+                dir_index_put(larger, slot);
+        }
+        dir_index_free(index);
+        inode->dir_index = index = larger;
+    }
+    dir_index_put(index, dir_slot(hash, offset));
+}
+
+// remove the entry at `offset` with a name of `hash` from the index of
+// `inode`. The slots after it move back in its place where they can, so that
+// a lookup never stops at an empty slot before the slot it looks for.
+static void dir_index_remove(Inode* inode, u32 hash, usize offset) {
+    DirIndex* index = inode->dir_index;
+    usize mask = index->num_slots - 1;
+    usize i = hash & mask;
+    while (*dir_index_slot(index, i) != dir_slot(hash, offset)) {
+        if (*dir_index_slot(index, i) == 0)
+            return;
+        i = (i + 1) & mask;
+    }
+
+    index->num_used--;
+    for (usize j = i;;) {
+        *dir_index_slot(index, i) = 0;
+        u64 slot;
+        usize home;
+        do {
+            j = (j + 1) & mask;
+            slot = *dir_index_slot(index, j);
+            if (slot == 0)
+                return;
+            home = (slot >> 32) & mask;
+        } while (i <= j ? i < home && home <= j : i < home || home <= j);
+        *dir_index_slot(index, i) = slot;
+        i = j;
+    }
+}
+
+// return whether directory `inode` has a name index, building it first if
+// the directory is large enough but not too large for one.
+static bool dir_index_ready(Inode* inode) {
+    usize num_bytes = inode->entry.num_bytes;
+    if (inode->dir_index || num_bytes <= DIR_INDEX_MIN_BYTES || num_bytes > DIR_INDEX_MAX_BYTES)
+        return inode->dir_index != NULL;
+    usize num_slots = DIR_INDEX_SLOTS_PER_PAGE;
+    while (num_slots * 3 < num_bytes / sizeof(DirEntry) * 4)
+        num_slots *= 2;
+    DirIndex* index = dir_index_alloc(num_slots);
+    if (!index)
+        return false;
+
+    for (usize offset = 0; offset < num_bytes; offset += BLOCK_SIZE) {
+        usize block_no = inode_peek(inode, offset / BLOCK_SIZE);
+        if (block_no == 0)
+            continue;
+        Block* block = cache->acquire(block_no);
+        DirEntry* de = (DirEntry*)block->data;
+        usize n = MIN(num_bytes - offset, (usize)BLOCK_SIZE) / sizeof(DirEntry);
+        for (usize i = 0; i < n; i++) {
+            if (de[i].inode_no != 0)
+                dir_index_put(index, dir_slot(dir_hash(de[i].name), offset + i * sizeof(DirEntry)));
+        }
+        cache->release(block);
+    }
+    inode->dir_index = index;
+    return true;
+}
+
+// read the entry at `offset` of directory `inode` straight from its block,
+// leaving the read-ahead state of `inode_read` alone.
+static void dir_read(Inode* inode, usize offset, DirEntry* de) {
+    usize block_no = inode_peek(inode, offset / BLOCK_SIZE);
+    if (block_no == 0) {
+        memset(de, 0, sizeof(*de));
+        return;
+    }
+    Block* block = cache->acquire(block_no);
+    memmove(de, block->data + offset % BLOCK_SIZE, sizeof(*de));
+    cache->release(block);
+}
+
+// scan directory `inode` a block at a time from `offset` on, for the entry
+// named `name`, or for a free entry if `name` is NULL. Return its offset, or
+// `num_bytes` if there is none.
+static usize dir_scan(Inode* inode, usize offset, const char* name) {
+    usize num_bytes = inode->entry.num_bytes;
+    while (offset < num_bytes) {
+        // blocks never written to are all free entries.
+        usize block_no = inode_peek(inode, offset / BLOCK_SIZE);
+        if (block_no == 0) {
+            if (!name)
+                return offset;
+            offset = (offset / BLOCK_SIZE + 1) * BLOCK_SIZE;
+            continue;
+        }
+
+        Block* block = cache->acquire(block_no);
+        usize end = MIN(num_bytes, (offset / BLOCK_SIZE + 1) * BLOCK_SIZE);
+        for (; offset < end; offset += sizeof(DirEntry)) {
+            DirEntry* de = (DirEntry*)(block->data + offset % BLOCK_SIZE);
+            if (name ? de->inode_no != 0 && strncmp(de->name, name, FILE_NAME_MAX_LENGTH) == 0
+                     : de->inode_no == 0)
+                break;
+        }
+        cache->release(block);
+        if (offset < end)
+            return offset;
+    }
+    return num_bytes;
+}
+
 // see `inode.h`.
 static usize inode_lookup(Inode* inode, const char* name, usize* index) {
     InodeEntry* entry = &inode->entry;
     assert(entry->type == INODE_DIRECTORY);
 
-    // TODO
-    u32 off, inum;
     DirEntry de;
-    for (off = 0; off < entry->num_bytes; off += sizeof(DirEntry)) {
-        inode_read(inode, (void*)&de, off, sizeof(DirEntry));
-        if (de.inode_no == 0)
-            continue;
-        if (strncmp(de.name, name, FILE_NAME_MAX_LENGTH) == 0) {
-            if (index)
-                *index = off;
-            inum = de.inode_no;
-            // FIXME
-            return inum;
+    usize offset = entry->num_bytes;
+    if (dir_index_ready(inode)) {
+        // only entries whose names hash the same are read.
+        u32 hash = dir_hash(name);
+        DirIndex* dir_index = inode->dir_index;
+        usize mask = dir_index->num_slots - 1;
+        for (usize i = hash & mask; *dir_index_slot(dir_index, i) != 0; i = (i + 1) & mask) {
+            u64 slot = *dir_index_slot(dir_index, i);
+            if (slot >> 32 != hash)
+                continue;
+            usize candidate = ((slot & 0xffffffff) - 1) * sizeof(DirEntry);
+            dir_read(inode, candidate, &de);
+            if (strncmp(de.name, name, FILE_NAME_MAX_LENGTH) == 0) {
+                offset = candidate;
+                break;
+            }
         }
+    } else {
+        offset = dir_scan(inode, 0, name);
+        if (offset < entry->num_bytes)
+            dir_read(inode, offset, &de);
     }
+    if (offset == entry->num_bytes)
+        return 0;
 
-    return 0;
+    if (index)
+        *index = offset;
+    return de.inode_no;
 }
 
 // see `inode.h`.
@@ -370,33 +1029,44 @@ static usize inode_insert(OpContext* ctx,
     InodeEntry* entry = &inode->entry;
     assert(entry->type == INODE_DIRECTORY);
 
-    // TODO
-    usize index;
-    if (inode_lookup(inode, name, &index) != 0) {
-        // printf("???\n");
+    if (inode_lookup(inode, name, NULL) != 0)
         return -1;
-    }
-    u32 off;
+
+    // the first free entry, or a new one at the end.
+    usize offset = dir_scan(inode, inode->dir_free, NULL);
     DirEntry de;
-    for (off = 0; off < inode->entry.num_bytes; off += sizeof(DirEntry)) {
-        inode_read(inode, (void*)&de, off, sizeof(DirEntry));
-        if (de.inode_no == 0)
-            break;
-    }
+    memset(&de, 0, sizeof(de));
     strncpy(de.name, name, FILE_NAME_MAX_LENGTH);
-    de.inode_no = inode_no;
-    inode_write(ctx, inode, (void*)&de, off, sizeof(DirEntry));
-    return off;
+    de.inode_no = (u16)inode_no;
+    inode_write(ctx, inode, (u8*)&de, offset, sizeof(de));
+    dentry_forget(inode->inode_no, name);
+
+    if (inode->dir_index) {
+        if (entry->num_bytes > DIR_INDEX_MAX_BYTES)
+            reset_dir_index(inode);
+        else
+            dir_index_add(inode, dir_hash(name), offset);
+    }
+    inode->dir_free = offset + sizeof(de);
+    return offset;
 }
 
 // see `inode.h`.
 static void inode_remove(OpContext* ctx, Inode* inode, usize index) {
     InodeEntry* entry = &inode->entry;
     assert(entry->type == INODE_DIRECTORY);
+
     DirEntry de;
+    dir_read(inode, index, &de);
+    if (de.inode_no == 0)
+        return;
+    if (inode->dir_index)
+        dir_index_remove(inode, dir_hash(de.name), index);
+    dentry_forget(inode->inode_no, de.name);
+
     memset(&de, 0, sizeof(de));
-    inode_write(ctx, inode, (void*)&de, index, sizeof(DirEntry));
-    // TODO
+    inode_write(ctx, inode, (u8*)&de, index, sizeof(de));
+    inode->dir_free = MIN(inode->dir_free, index);
 }
 
 /* Paths. */
@@ -465,10 +1135,15 @@ static Inode* namex(const char* path,
             inode_unlock(ip);
             return ip;
         }
-        // FIXME:call iget here
-        int ind_no = inode_lookup(ip, name, 0);
+        // names looked up before, found or not, are in the dentry cache.
+        usize ind_no;
+        if (!dentry_lookup(ip->inode_no, name, &ind_no)) {
+            ind_no = inode_lookup(ip, name, 0);
+            dentry_add(ip->inode_no, name, ind_no);
+        }
         if (ind_no == 0) {
             inode_unlock(ip);
+            inode_put(ctx, ip);
             return 0;
         }
         nx = inode_get(ind_no);
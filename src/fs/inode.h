@@ -9,7 +9,28 @@
 
 #define ROOT_INODE_NO 1
 
+// the read-ahead window starts at `READ_AHEAD_MIN_WINDOW` blocks on sequential
+// reads, and doubles on each sequential read up to `READ_AHEAD_MAX_WINDOW`.
+#define READ_AHEAD_MIN_WINDOW 4
+#define READ_AHEAD_MAX_WINDOW 32
+
+// in-memory inodes are found through `INODE_HASH_SIZE` hash buckets. Up to
+// `INODE_CACHE_SIZE` inodes that nobody refers to are kept with their entries,
+// so that getting them again does not read the disk.
+#define INODE_HASH_SIZE  64
+#define INODE_CACHE_SIZE 64
+
+// `namei` caches up to `DENTRY_CACHE_SIZE` names it looked up in directories,
+// including names that did not exist, in `DENTRY_HASH_SIZE` hash buckets.
+#define DENTRY_CACHE_SIZE 128
+#define DENTRY_HASH_SIZE  64
+
+// the name indexes of up to `DIR_INDEX_CACHE_SIZE` large directories are kept
+// after their inodes leave memory, see `inode_lookup`.
+#define DIR_INDEX_CACHE_SIZE 16
+
 struct InodeTree;
+struct DirIndex;
 
 typedef struct {
     // lock protects:
@@ -18,11 +39,33 @@ typedef struct {
     SpinLock lock;
 
     RefCount rc;
-    ListNode node;
+    ListNode node;       // in the list of unused inodes, if `rc` is 0.
+    ListNode hash_node;  // in the hash bucket of `inode_no`.
     usize inode_no;
 
     bool valid;        // is `entry` loaded?
     InodeEntry entry;  // real inode data on the disk.
+
+    // sequential read-ahead state, see `inode_read`.
+    usize ra_next;    // index of the block that a sequential read touches next.
+    usize ra_window;  // number of blocks to prefetch ahead of the reader.
+    usize ra_end;     // blocks before this index have been prefetched.
+
+    // where the next block of the file had better be allocated, see
+    // `inode_map`. 0 if there is no preference.
+    usize alloc_goal;
+
+    // a copy of the extent that mapped the last block looked up, so that
+    // sequential access does not walk the extent tree for every block.
+    Extent ext;
+    usize ext_node;   // the leaf node holding `ext`, or 0 if it is in `entry`.
+    usize ext_index;  // the index of `ext` in its leaf.
+    bool ext_last;    // whether `ext` is the last extent of the file.
+
+    // for directory inode only, see `inode_lookup` and `inode_insert`.
+    struct DirIndex *dir_index;  // hash index of the names in a large directory,
+                                 // or NULL.
+    usize dir_free;  // entries before this offset are all in use.
 } Inode;
 
 typedef struct InodeTree {
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <common/defines.h>
+
+/**
+ * this file contains the statistics the block cache exports to user space,
+ * see `sys_cachestat`. It is included by user programs, so it should not
+ * depend on other kernel headers.
+ */
+
+// counters of the logging layer, for measurement.
+typedef struct {
+    usize num_commits;      // transactions written to the log.
+    usize num_checkpoints;  // times the log is truncated.
+    usize num_log_writes;   // blocks written to the log area.
+    usize num_home_writes;  // blocks written to their home locations by checkpoints.
+    usize num_data_writes;  // file data blocks written in place, see `JOURNAL_ORDERED`.
+} LogStats;
+
+// number of buckets in the histograms of `CacheStats`. Bucket `i` counts the
+// samples in `[2^(i-1), 2^i)`, bucket 0 the zeros, and the last bucket all
+// samples beyond.
+#define CACHE_STATS_NUM_BUCKETS 16
+
+// counters of the block cache, for sizing the cache and the log. Times are
+// in microseconds.
+typedef struct {
+    usize num_hits;       // `acquire` found the content cached.
+    usize num_misses;     // `acquire` had to read the block from disk.
+    usize num_evictions;  // blocks evicted from the cache.
+    usize num_cached;     // see `get_num_cached_blocks`.
+    usize capacity;       // see `get_capacity`.
+    usize num_pinned;     // cached blocks that can not be evicted.
+    usize num_dirty;      // blocks changed by the running transaction.
+    usize log_size;       // log blocks a transaction may take.
+    usize num_reserved;   // log blocks taken or reserved by now.
+    usize num_ops;        // atomic operations that reserved log space.
+    usize num_waits;      // of them, the ones that waited in `begin_op`.
+    usize wait_time;      // time spent waiting in `begin_op`.
+    // transactions by the number of log blocks they took, not counting
+    // descriptor blocks.
+    usize commit_size[CACHE_STATS_NUM_BUCKETS];
+    // transactions by the time to write them.
+    usize commit_time[CACHE_STATS_NUM_BUCKETS];
+    LogStats log;
+} CacheStats;
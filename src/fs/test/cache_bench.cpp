@@ -0,0 +1,218 @@
+extern "C" {
+#include <fs/cache.h>
+}
+
+#include "mock/block_device.hpp"
+#include "mock/memory.hpp"
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// average latency of `acquire` + `release` in nanoseconds, when `num_blocks`
+// distinct blocks are accessed uniformly at random. The cache grows to hold
+// them all, as it does with plenty of free memory.
+auto measure_acquire(usize num_blocks, usize num_rounds) -> double {
+    mock_memory.num_free_pages = CACHE_MIN_FREE_PAGES + 1;
+    initialize(1, num_blocks);
+
+    usize t = sblock.num_blocks - num_blocks;
+    for (usize i = 0; i < num_blocks; i++) {
+        bcache.release(bcache.acquire(t + i));
+    }
+
+    std::mt19937 gen(0x19260817);
+    std::vector<usize> trace(num_rounds);
+    for (auto &bno : trace) {
+        bno = t + gen() % num_blocks;
+    }
+
+    usize read_count = mock.read_count;
+    auto begin_ts = std::chrono::steady_clock::now();
+    for (usize bno : trace) {
+        bcache.release(bcache.acquire(bno));
+    }
+    auto end_ts = std::chrono::steady_clock::now();
+
+    if (mock.read_count != read_count)
+        throw Internal("working set does not fit in block cache");
+
+    auto duration =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end_ts - begin_ts).count();
+    return static_cast<double>(duration) / num_rounds;
+}
+
+// throughput of `acquire` + `release` in operations per second, when
+// `num_workers` threads access a resident working set concurrently.
+auto measure_parallel_acquire(usize num_workers, usize num_rounds) -> double {
+    constexpr usize num_blocks = 1024;
+    initialize(1, num_blocks);
+
+    usize t = sblock.num_blocks - num_blocks;
+    for (usize i = 0; i < num_blocks; i++) {
+        bcache.release(bcache.acquire(t + i));
+    }
+
+    std::atomic<bool> started = false;
+    std::vector<std::thread> workers;
+    for (usize i = 0; i < num_workers; i++) {
+        workers.emplace_back([&, i] {
+            std::mt19937 gen(i);
+            while (!started) {
+                std::this_thread::yield();
+            }
+            for (usize j = 0; j < num_rounds; j++) {
+                bcache.release(bcache.acquire(t + gen() % num_blocks));
+            }
+        });
+    }
+
+    auto begin_ts = std::chrono::steady_clock::now();
+    started = true;
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    auto end_ts = std::chrono::steady_clock::now();
+
+    auto duration =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end_ts - begin_ts).count();
+    return static_cast<double>(num_workers * num_rounds) * 1e9 / duration;
+}
+
+// block numbers accessed by a workload, relative to the first data block.
+using Trace = std::vector<usize>;
+
+constexpr usize trace_length = 200000;
+constexpr usize num_metadata_blocks = EVICTION_THRESHOLD / 4;
+constexpr usize num_file_blocks = EVICTION_THRESHOLD * 8;
+constexpr usize num_trace_blocks = num_metadata_blocks + num_file_blocks;
+
+// inode and bitmap blocks, where a few of them are far more popular.
+auto metadata_access(std::mt19937 &gen) -> usize {
+    usize x = gen() % num_metadata_blocks;
+    return x * x / num_metadata_blocks;
+}
+
+// a file read from beginning to end, at a random place of the file area.
+void append_stream(Trace &trace, std::mt19937 &gen, usize length) {
+    usize start = num_metadata_blocks + gen() % (num_file_blocks - length);
+    for (usize i = 0; i < length && trace.size() < trace_length; i++) {
+        trace.push_back(start + i);
+    }
+}
+
+auto metadata_trace() -> Trace {
+    std::mt19937 gen(0x1234);
+    Trace trace;
+    while (trace.size() < trace_length) {
+        trace.push_back(metadata_access(gen));
+    }
+    return trace;
+}
+
+auto streaming_trace() -> Trace {
+    std::mt19937 gen(0x5678);
+    Trace trace;
+    while (trace.size() < trace_length) {
+        append_stream(trace, gen, EVICTION_THRESHOLD * 2);
+    }
+    return trace;
+}
+
+// metadata lookups, interrupted by reads of files larger than the cache,
+// like `ls` and `exec` running next to `cat`.
+auto mixed_trace() -> Trace {
+    std::mt19937 gen(0x9abc);
+    Trace trace;
+    while (trace.size() < trace_length) {
+        for (usize i = 0; i < EVICTION_THRESHOLD * 2 && trace.size() < trace_length; i++) {
+            trace.push_back(metadata_access(gen));
+        }
+        append_stream(trace, gen, EVICTION_THRESHOLD * 3 / 2);
+    }
+    return trace;
+}
+
+// replay `trace` with `acquire` + `release`, and print the hit rate and the
+// throughput in operations per second.
+void replay(const char *name, const Trace &trace, CachePolicy policy) {
+    initialize(1, num_trace_blocks);
+    bcache.set_policy(policy);
+
+    usize t = sblock.num_blocks - num_trace_blocks;
+    usize read_count = mock.read_count;
+    auto begin_ts = std::chrono::steady_clock::now();
+    for (usize bno : trace) {
+        bcache.release(bcache.acquire(t + bno));
+    }
+    auto end_ts = std::chrono::steady_clock::now();
+
+    usize num_misses = mock.read_count - read_count;
+    auto duration =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end_ts - begin_ts).count();
+    printf("(info) %-8s %-3s: hit rate = %5.1f%%, %.0f ops/s\n",
+           name,
+           policy == CACHE_POLICY_LRU ? "LRU" : "2Q",
+           100.0 * (trace.size() - num_misses) / trace.size(),
+           static_cast<double>(trace.size()) * 1e9 / duration);
+}
+
+// `init_bcache` can only be called once in a process, so every measurement
+// runs in a child process.
+void run_isolated(const std::function<void()> &func) {
+    fflush(stdout);
+
+    int pid;
+    if ((pid = fork()) == 0) {
+        func();
+        exit(0);
+    }
+
+    int wstatus;
+    waitpid(pid, &wstatus, 0);
+    if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0)
+        throw Internal("benchmark exited abnormally");
+}
+
+}  // namespace
+
+int main() {
+    constexpr usize num_rounds = 200000;
+
+    printf("(info) acquire latency with all blocks resident:\n");
+    for (usize num_blocks = 16; num_blocks <= EVICTION_THRESHOLD * 64; num_blocks *= 2) {
+        run_isolated([&] {
+            printf("(info) #cached = %6zu: %.1f ns/op\n",
+                   num_blocks,
+                   measure_acquire(num_blocks, num_rounds));
+        });
+    }
+
+    printf("(info) acquire throughput with %d shards:\n", CACHE_NUM_SHARDS);
+    for (usize num_workers = 1; num_workers <= 8; num_workers *= 2) {
+        run_isolated([&] {
+            printf("(info) #workers = %zu: %.0f ops/s\n",
+                   num_workers,
+                   measure_parallel_acquire(num_workers, num_rounds / num_workers));
+        });
+    }
+
+    printf("(info) replacement policies on block traces:\n");
+    const std::pair<const char *, Trace> traces[] = {
+        {"metadata", metadata_trace()},
+        {"stream", streaming_trace()},
+        {"mixed", mixed_trace()},
+    };
+    for (const auto &[name, trace] : traces) {
+        for (auto policy : {CACHE_POLICY_LRU, CACHE_POLICY_2Q}) {
+            run_isolated([&] { replay(name, trace, policy); });
+        }
+    }
+
+    return 0;
+}
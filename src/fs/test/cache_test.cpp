@@ -1,4 +1,5 @@
 extern "C" {
+#include <aarch64/mmu.h>
 #include <fs/cache.h>
 }
 
@@ -7,12 +8,17 @@ extern "C" {
 #include "runner.hpp"
 
 #include "mock/block_device.hpp"
+#include "mock/memory.hpp"
 
 #include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <random>
+#include <set>
 #include <thread>
 
+#include <sys/mman.h>
+
 namespace {
 
 constexpr int IN_CHILD = 0;
@@ -27,6 +33,58 @@ static void wait_process(int pid) {
     }
 }
 
+// the transaction that replay would install first, if it is intact.
+static auto replayable_header() -> LogHeader* {
+    auto* tail = mock.inspect_log_tail();
+    usize size = sblock.num_log_blocks - 1;
+    auto* header = mock.inspect_log_header(tail->start % size);
+    if (header->magic != LOG_MAGIC || header->seq != tail->seq ||
+        header->num_blocks > LOG_MAX_SIZE ||
+        header->num_descriptors != LOG_NUM_DESCRIPTORS(header->num_blocks) ||
+        header->num_descriptors + header->num_blocks > size)
+        return nullptr;
+
+    LogHeader copy = *header;
+    copy.checksum = 0;
+    u32 sum = log_checksum(LOG_CHECKSUM_INIT, reinterpret_cast<u8*>(&copy));
+    for (usize i = 1; i < header->num_descriptors + header->num_blocks; i++) {
+        sum = log_checksum(sum, mock.inspect_log((tail->start + i) % size));
+    }
+    return sum == header->checksum ? header : nullptr;
+}
+
+// write a committed transaction of `block_nos` at the start of an empty log.
+// `fill` makes up the content of each log block.
+static void commit_log(const std::vector<usize>& block_nos,
+                       const std::function<void(usize i, u8* b)>& fill) {
+    usize n = block_nos.size(), d = LOG_NUM_DESCRIPTORS(n);
+    auto* header = mock.inspect_log_header(0);
+    for (usize i = 0; i < d; i++) {
+        std::fill_n(mock.inspect_log(i), BLOCK_SIZE, 0);
+    }
+    header->magic = LOG_MAGIC;
+    header->seq = mock.inspect_log_tail()->seq;
+    header->num_blocks = static_cast<u32>(n);
+    header->num_descriptors = static_cast<u32>(d);
+    for (usize i = 0; i < n; i++) {
+        u32* block_no = &header->block_no[i];
+        if (i >= LOG_HEADER_NUM_BLOCKS) {
+            usize j = i - LOG_HEADER_NUM_BLOCKS;
+            auto* descriptor = reinterpret_cast<LogDescriptor*>(
+                mock.inspect_log(1 + j / LOG_DESCRIPTOR_NUM_BLOCKS));
+            block_no = &descriptor->block_no[j % LOG_DESCRIPTOR_NUM_BLOCKS];
+        }
+        *block_no = static_cast<u32>(block_nos[i]);
+        fill(i, mock.inspect_log(d + i));
+    }
+
+    u32 sum = LOG_CHECKSUM_INIT;
+    for (usize i = 0; i < d + n; i++) {
+        sum = log_checksum(sum, mock.inspect_log(i));
+    }
+    header->checksum = sum;
+}
+
 }  // namespace
 
 namespace basic {
@@ -128,8 +186,9 @@ void test_lru() {
 
     usize cold_size = 1000;
     usize hot_size = EVICTION_THRESHOLD * 0.8;
+    usize num_rounds = hot_size * 60;
     initialize(1, cold_size + hot_size);
-    for (int i = 0; i < 1000; i++) {
+    for (usize i = 0; i < num_rounds; i++) {
         bool hot = (gen() % 100) <= 90;
         usize bno = hot ? (gen() % hot_size) : (hot_size + gen() % cold_size);
 
@@ -142,10 +201,176 @@ void test_lru() {
     printf("(debug) #cached = %zu, #read = %zu\n",
            bcache.get_num_cached_blocks(), mock.read_count.load());
     assert_true(bcache.get_num_cached_blocks() <= EVICTION_THRESHOLD);
-    assert_true(mock.read_count < 233);
+    assert_true(mock.read_count < hot_size + num_rounds / 5);
     assert_true(mock.write_count < 5);
 }
 
+// targets: `set_policy`.
+void test_scan_resistance() {
+    constexpr usize hot_size = 256;
+    constexpr usize num_warmups = 16;
+    constexpr usize warmup_size = 128;
+    constexpr usize scan_size = EVICTION_THRESHOLD * 2;
+    constexpr usize region_size = hot_size + num_warmups * warmup_size + scan_size;
+
+    initialize(1, region_size * 2);
+
+    // hot blocks are used between small scans, then a scan larger than the
+    // cache passes by. return how many hot blocks are read again afterwards.
+    auto run = [&](usize t) {
+        auto touch = [&](usize bno) { bcache.release(bcache.acquire(t - bno)); };
+        usize bno = hot_size;
+        for (usize i = 0; i < num_warmups; i++) {
+            for (usize j = 0; j < hot_size; j++) {
+                touch(j);
+            }
+            for (usize j = 0; j < warmup_size; j++) {
+                touch(bno++);
+            }
+        }
+        for (usize j = 0; j < scan_size; j++) {
+            touch(bno++);
+        }
+
+        usize read_count = mock.read_count;
+        for (usize j = 0; j < hot_size; j++) {
+            touch(j);
+        }
+        return mock.read_count - read_count;
+    };
+
+    usize t = sblock.num_blocks - 1;
+    usize num_2q_misses = run(t);
+    bcache.set_policy(CACHE_POLICY_LRU);
+    usize num_lru_misses = run(t - region_size);
+
+    printf("(debug) hot misses after scan: 2Q = %zu, LRU = %zu\n", num_2q_misses, num_lru_misses);
+    assert_eq(num_2q_misses, 0);
+    assert_eq(num_lru_misses, hot_size);
+    assert_true(bcache.get_num_cached_blocks() <= EVICTION_THRESHOLD);
+}
+
+// targets: `set_capacity`.
+void test_capacity() {
+    initialize(1, 1000);
+
+    usize t = sblock.num_blocks - 1;
+    usize num_cached = bcache.get_num_cached_blocks();
+    for (usize i = 0; i < 500; i++) {
+        bcache.release(bcache.acquire(t - i));
+    }
+    assert_eq(bcache.get_num_cached_blocks(), num_cached + 500);
+
+    // shrinking evicts unused blocks right away.
+    bcache.set_capacity(100);
+    assert_eq(bcache.get_capacity(), 100);
+    assert_true(bcache.get_num_cached_blocks() <= 100);
+
+    for (usize i = 0; i < 1000; i++) {
+        bcache.release(bcache.acquire(t - i));
+    }
+    assert_true(bcache.get_num_cached_blocks() <= 100);
+
+    // blocks in use stay, even beyond the capacity.
+    std::vector<Block*> p;
+    for (usize i = 0; i < 200; i++) {
+        p.push_back(bcache.acquire(t - i));
+    }
+    assert_eq(bcache.get_num_cached_blocks(), 200);
+    for (auto* b : p) {
+        bcache.release(b);
+    }
+
+    // growing lets the cache keep more blocks.
+    bcache.set_capacity(1000);
+    usize read_count = mock.read_count;
+    for (usize round = 0; round < 2; round++) {
+        for (usize i = 0; i < 500; i++) {
+            bcache.release(bcache.acquire(t - i));
+        }
+    }
+    assert_true(mock.read_count - read_count <= 500);
+}
+
+void test_buffer_layout() {
+    initialize(1, 100);
+
+    // buffers lie apart from `Block` struct, several to a page.
+    usize t = sblock.num_blocks - 1;
+    std::vector<Block*> p;
+    for (usize i = 0; i < 64; i++) {
+        p.push_back(bcache.acquire(t - i));
+    }
+    std::set<usize> pages;
+    for (auto* b : p) {
+        auto data = reinterpret_cast<usize>(b->data);
+        assert_eq(data % BLOCK_SIZE, 0);
+        assert_true(data + BLOCK_SIZE <= reinterpret_cast<usize>(b) ||
+                    data >= reinterpret_cast<usize>(b + 1));
+        pages.insert(data / PAGE_SIZE);
+    }
+    assert_true(pages.size() <= 64 / (PAGE_SIZE / BLOCK_SIZE) + CACHE_NUM_SHARDS);
+    for (auto* b : p) {
+        bcache.release(b);
+    }
+}
+
+void test_memory_pressure() {
+    constexpr usize num_blocks = EVICTION_THRESHOLD + 500;
+
+    initialize(OP_MAX_NUM_BLOCKS, num_blocks);
+
+    // with plenty of free pages, the cache grows instead of evicting.
+    mock_memory.num_free_pages = CACHE_MIN_FREE_PAGES + 1;
+    usize t = sblock.num_blocks - 1;
+    usize num_cached = bcache.get_num_cached_blocks();
+    for (usize i = 0; i < num_blocks; i++) {
+        bcache.release(bcache.acquire(t - i));
+    }
+    assert_eq(bcache.get_num_cached_blocks(), num_cached + num_blocks);
+    assert_true(bcache.get_capacity() >= num_blocks);
+
+    // `kalloc` runs out: a page is given back after a page's worth of blocks
+    // is dropped.
+    mock_memory.num_free_pages = 0;
+    num_cached = bcache.get_num_cached_blocks();
+    assert_eq(mock_memory.reclaim(1), 1);
+    assert_true(bcache.get_num_cached_blocks() < num_cached);
+    assert_true(bcache.get_num_cached_blocks() > num_cached / 2);
+
+    // asking for more drops every block but those in use or pinned.
+    auto* a = bcache.acquire(t);
+    OpContext ctx;
+    bcache.begin_op(&ctx);
+    auto* b = bcache.acquire(t - 1);
+    bcache.sync(&ctx, b);
+    bcache.release(b);
+    assert_true(mock_memory.reclaim(num_blocks) > 0);
+    assert_eq(bcache.get_num_cached_blocks(), 2);
+    assert_eq(bcache.get_capacity(), 2);
+    bcache.end_op(&ctx);
+    bcache.release(a);
+
+    // it stays small until free pages are plenty again.
+    for (usize i = 0; i < 100; i++) {
+        bcache.release(bcache.acquire(t - i));
+    }
+    assert_true(bcache.get_num_cached_blocks() <= 2);
+    mock_memory.num_free_pages = CACHE_MIN_FREE_PAGES + 1;
+    for (usize i = 0; i < 100; i++) {
+        bcache.release(bcache.acquire(t - i));
+    }
+    assert_true(bcache.get_num_cached_blocks() >= 100);
+
+    // a fixed capacity does not grow.
+    bcache.set_capacity(50);
+    for (usize i = 0; i < 200; i++) {
+        bcache.release(bcache.acquire(t - i));
+    }
+    assert_eq(bcache.get_capacity(), 50);
+    assert_true(bcache.get_num_cached_blocks() <= 50);
+}
+
 // targets: `begin_op`, `end_op`, `sync`.
 
 void test_atomic_op() {
@@ -227,6 +452,192 @@ void test_overflow() {
     assert_eq(panicked, true);
 }
 
+// targets: `begin_op_sized`.
+void test_reservation() {
+    constexpr usize op_size = 2;
+    constexpr usize num_ops = OP_MAX_NUM_BLOCKS / op_size;
+
+    // the log only has room for one `OP_MAX_NUM_BLOCKS` reservation, but
+    // all the small operations should be able to run at the same time.
+    initialize(OP_MAX_NUM_BLOCKS + 1, num_ops * op_size);
+
+    usize t = sblock.num_blocks - 1;
+    std::atomic<usize> num_begun = 0;
+    std::atomic<bool> overlapped = true;
+    std::vector<std::thread> threads;
+    for (usize i = 0; i < num_ops; i++) {
+        threads.emplace_back([&, i] {
+            OpContext ctx;
+            bcache.begin_op_sized(&ctx, op_size);
+            num_begun++;
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+            while (num_begun < num_ops) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    overlapped = false;
+                    break;
+                }
+                std::this_thread::yield();
+            }
+
+            for (usize j = 0; j < op_size; j++) {
+                auto* b = bcache.acquire(t - i * op_size - j);
+                b->data[0] = 0x5a;
+                bcache.sync(&ctx, b);
+                bcache.release(b);
+            }
+            bcache.end_op(&ctx);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    assert_eq(overlapped.load(), true);
+    for (usize i = 0; i < num_ops * op_size; i++) {
+        assert_eq(mock.inspect(t - i)[0], 0x5a);
+    }
+
+    // an operation cannot write more blocks than it reserved.
+    OpContext ctx;
+    bcache.begin_op_sized(&ctx, 1);
+    auto* b = bcache.acquire(t);
+    bcache.sync(&ctx, b);
+    bcache.release(b);
+
+    bool panicked = false;
+    b = bcache.acquire(t - 1);
+    try {
+        bcache.sync(&ctx, b);
+    } catch (const Panic&) {
+        panicked = true;
+    }
+
+    assert_eq(panicked, true);
+}
+
+// targets: `begin_read_op`, `upgrade_op`.
+void test_read_only_op() {
+    initialize(OP_MAX_NUM_BLOCKS + 1, 1);
+
+    // a regular operation takes the whole log.
+    OpContext writer;
+    bcache.begin_op(&writer);
+
+    // read-only operations neither need log space nor wait.
+    OpContext reader;
+    bcache.begin_read_op(&reader);
+    bcache.end_op(&reader);
+
+    // but an upgraded one does.
+    std::atomic<bool> upgraded = false;
+    bcache.begin_read_op(&reader);
+    std::thread thread([&] {
+        bcache.upgrade_op(&reader);
+        upgraded = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assert_eq(upgraded.load(), false);
+    bcache.end_op(&writer);
+    thread.join();
+    assert_eq(upgraded.load(), true);
+
+    usize t = sblock.num_blocks - 1;
+    auto* b = bcache.acquire(t);
+    b->data[0] = 0x3c;
+    bcache.sync(&reader, b);
+    bcache.release(b);
+    bcache.end_op(&reader);
+    assert_eq(mock.inspect(t)[0], 0x3c);
+
+    // modifications need an upgrade.
+    bool panicked = false;
+    bcache.begin_read_op(&reader);
+    b = bcache.acquire(t);
+    try {
+        bcache.sync(&reader, b);
+    } catch (const Panic&) {
+        panicked = true;
+    }
+
+    assert_eq(panicked, true);
+}
+
+void test_ordered_data() {
+    initialize(32, 64);
+    bcache.set_journal_mode(JOURNAL_ORDERED);
+
+    usize t = sblock.num_blocks - 1;
+    auto* d = mock.inspect(t);
+    auto* d1 = mock.inspect(t - 1);
+    auto* d2 = mock.inspect(t - 2);
+    u8 v = d[0], v1 = d1[0], v2 = d2[0];
+
+    // file data goes in place at commit and takes no log slot.
+    OpContext ctx;
+    bcache.begin_op(&ctx);
+    auto* b = bcache.acquire(t);
+    b->data[0] = ~v;
+    bcache.sync_data(&ctx, b);
+    bcache.sync_data(&ctx, b);
+    bcache.release(b);
+    b = bcache.acquire(t - 1);
+    b->data[0] = ~v1;
+    bcache.sync(&ctx, b);
+    bcache.release(b);
+    assert_eq(d[0], v);
+    bcache.end_op(&ctx);
+    assert_eq(d[0], (u8)~v);
+    assert_eq(d1[0], (u8)~v1);
+
+    LogStats stats;
+    bcache.get_log_stats(&stats);
+    assert_eq(stats.num_data_writes, 1);
+    assert_eq(stats.num_log_writes, 1);
+
+    // a block that turns into metadata within the transaction is logged,
+    // reusing its slot.
+    bcache.begin_op_sized(&ctx, 1);
+    b = bcache.acquire(t - 2);
+    b->data[0] = ~v2;
+    bcache.sync_data(&ctx, b);
+    bcache.sync(&ctx, b);
+    bcache.release(b);
+    bcache.end_op(&ctx);
+    assert_eq(d2[0], (u8)~v2);
+
+    bcache.get_log_stats(&stats);
+    assert_eq(stats.num_data_writes, 1);
+    assert_eq(stats.num_log_writes, 2);
+
+    // a block already logged stays in the log, so replay cannot undo it.
+    bcache.begin_op(&ctx);
+    b = bcache.acquire(t - 1);
+    b->data[0] = v1;
+    bcache.sync(&ctx, b);
+    bcache.sync_data(&ctx, b);
+    bcache.release(b);
+    bcache.end_op(&ctx);
+    assert_eq(d1[0], v1);
+
+    bcache.get_log_stats(&stats);
+    assert_eq(stats.num_data_writes, 1);
+    assert_eq(stats.num_log_writes, 3);
+
+    // so is a checkpointed one, as long as replay would install it.
+    bcache.begin_op(&ctx);
+    b = bcache.acquire(t - 1);
+    b->data[0] = ~v1;
+    bcache.sync_data(&ctx, b);
+    bcache.release(b);
+    bcache.end_op(&ctx);
+    assert_eq(d1[0], (u8)~v1);
+
+    bcache.get_log_stats(&stats);
+    assert_eq(stats.num_data_writes, 1);
+    assert_eq(stats.num_log_writes, 4);
+}
+
 void test_resident() {
     // NOTE: this test may be a little controversial.
     // the main ideas are:
@@ -348,28 +759,129 @@ void test_global_absorption() {
 
 // target: replay at initialization.
 
+void test_delta_log() {
+    initialize(32, 64);
+
+    // small changes of several blocks share one log block.
+    usize t = sblock.num_blocks - 1;
+    std::vector<u8> values;
+    OpContext ctx;
+    bcache.begin_op(&ctx);
+    for (usize i = 0; i < 8; i++) {
+        auto* b = bcache.acquire(t - i);
+        values.push_back((u8)~b->data[i * 8]);
+        b->data[i * 8] = values[i];
+        bcache.sync_range(&ctx, b, i * 8, 1);
+        bcache.release(b);
+    }
+    bcache.end_op(&ctx);
+
+    LogStats stats;
+    bcache.get_log_stats(&stats);
+    assert_eq(stats.num_log_writes, 1);
+    assert_eq(stats.num_home_writes, 8);
+    for (usize i = 0; i < 8; i++) {
+        assert_eq(mock.inspect(t - i)[i * 8], values[i]);
+    }
+
+    // ranges of a block merge, and large ones are logged whole.
+    bcache.begin_op(&ctx);
+    auto* b = bcache.acquire(t);
+    b->data[0]++;
+    bcache.sync_range(&ctx, b, 0, 1);
+    b->data[BLOCK_SIZE - 1]++;
+    bcache.sync_range(&ctx, b, BLOCK_SIZE - 1, 1);
+    bcache.release(b);
+    bcache.end_op(&ctx);
+
+    bcache.get_log_stats(&stats);
+    assert_eq(stats.num_log_writes, 2);
+}
+
 void test_replay() {
     initialize_mock(50, 1000);
 
-    auto* header = mock.inspect_log_header();
-    header->num_blocks = 5;
+    commit_log({500, 501, 502, 503, 504},
+               [](usize i, u8* b) { std::fill(b, b + BLOCK_SIZE, (500 + i) & 0xff); });
+
+    // a torn transaction after it is ignored.
+    auto* torn = mock.inspect_log_header(6);
+    *torn = *mock.inspect_log_header(0);
+    torn->seq++;
+    torn->num_blocks = 1;
+    auto* b = mock.inspect(600);
+    std::fill(b, b + BLOCK_SIZE, 0);
+    std::fill(mock.inspect_log(7), mock.inspect_log(7) + BLOCK_SIZE, 1);
+    torn->block_no[0] = 600;
+
+    init_bcache(&sblock, &device);
+
+    assert_true(replayable_header() == nullptr);
+    assert_eq(mock.inspect_log_tail()->start, 6);
+    for (usize j = 0; j < BLOCK_SIZE; j++) {
+        assert_eq(b[j], 0);
+    }
     for (usize i = 0; i < 5; i++) {
         usize v = 500 + i;
-        header->block_no[i] = v;
-        auto* b = mock.inspect_log(i);
+        auto* b = mock.inspect(v);
         for (usize j = 0; j < BLOCK_SIZE; j++) {
-            b[j] = v & 0xff;
+            assert_eq(b[j], v & 0xff);
         }
     }
+}
+
+void test_replay_delta() {
+    initialize_mock(50, 1000);
+
+    // one whole block, then records that patch it and another block.
+    commit_log({500, LOG_DELTA_BLOCK}, [](usize i, u8* d) {
+        if (i == 0) {
+            std::fill(d, d + BLOCK_SIZE, 1);
+            return;
+        }
+        std::fill(d, d + BLOCK_SIZE, 0);
+        auto* delta = reinterpret_cast<LogDelta*>(d);
+        *delta = {500, 8, 3};
+        std::fill(d + sizeof(LogDelta), d + sizeof(LogDelta) + 3, 2);
+        delta = reinterpret_cast<LogDelta*>(d + sizeof(LogDelta) + 8);
+        *delta = {501, 100, 1};
+        d[2 * sizeof(LogDelta) + 8] = 3;
+    });
+
+    auto* b = mock.inspect(501);
+    std::fill(b, b + BLOCK_SIZE, 0);
 
     init_bcache(&sblock, &device);
 
-    assert_eq(header->num_blocks, 0);
-    for (usize i = 0; i < 5; i++) {
-        usize v = 500 + i;
-        auto* b = mock.inspect(v);
+    assert_true(replayable_header() == nullptr);
+    auto* a = mock.inspect(500);
+    for (usize j = 0; j < BLOCK_SIZE; j++) {
+        assert_eq(a[j], j >= 8 && j < 11 ? 2 : 1);
+    }
+    for (usize j = 0; j < BLOCK_SIZE; j++) {
+        assert_eq(b[j], j == 100 ? 3 : 0);
+    }
+}
+
+void test_replay_large() {
+    constexpr usize num_blocks = LOG_MAX_SIZE;
+    initialize_mock(LOG_MAX_SIZE + LOG_MAX_DESCRIPTORS, 1000);
+
+    // the block numbers take several descriptor blocks.
+    std::vector<usize> block_nos;
+    for (usize i = 0; i < num_blocks; i++) {
+        block_nos.push_back(600 + i);
+    }
+    commit_log(block_nos, [](usize i, u8* b) { std::fill(b, b + BLOCK_SIZE, i & 0xff); });
+    assert_eq(mock.inspect_log_header(0)->num_descriptors, LOG_MAX_DESCRIPTORS);
+
+    init_bcache(&sblock, &device);
+
+    assert_true(replayable_header() == nullptr);
+    for (usize i = 0; i < num_blocks; i++) {
+        auto* b = mock.inspect(600 + i);
         for (usize j = 0; j < BLOCK_SIZE; j++) {
-            assert_eq(b[j], v & 0xff);
+            assert_eq(b[j], i & 0xff);
         }
     }
 }
@@ -467,6 +979,440 @@ void test_alloc_free() {
     }
 }
 
+// targets: `alloc` on a mostly full disk.
+void test_alloc_next_fit() {
+    constexpr usize num_data_blocks = BIT_PER_BLOCK * 2 - 256;
+
+    initialize(100, num_data_blocks);
+
+    auto alloc = [] {
+        OpContext ctx;
+        bcache.begin_op(&ctx);
+        usize no = bcache.alloc(&ctx);
+        bcache.end_op(&ctx);
+        return no;
+    };
+    auto free = [](usize no) {
+        OpContext ctx;
+        bcache.begin_op(&ctx);
+        bcache.free(&ctx, no);
+        bcache.end_op(&ctx);
+    };
+
+    // blocks are handed out one after another, across bitmap blocks.
+    std::vector<usize> bno;
+    for (usize i = 0; i < num_data_blocks - 10; i++) {
+        bno.push_back(alloc());
+        if (i > 0)
+            assert_eq(bno[i], bno[i - 1] + 1);
+    }
+
+    // the search goes on from the last allocation instead of the start, and
+    // only comes back to freed blocks after wrapping around.
+    free(bno[10]);
+    for (usize i = 0; i < 10; i++) {
+        bno.push_back(alloc());
+        assert_eq(bno.back(), bno[num_data_blocks - 11 + i] + 1);
+    }
+    assert_eq(alloc(), bno[10]);
+
+    // bitmap blocks without free bits are not looked into.
+    free(bno[20]);
+    usize read_count = mock.read_count;
+    mock.on_read = [&](usize bno, auto) {
+        if (bno == sblock.bitmap_start + 1)
+            throw Internal("full bitmap block is read");
+    };
+    bcache.set_capacity(1);
+    assert_eq(alloc(), bno[20]);
+    assert_true(mock.read_count - read_count <= 2);
+
+    bool panicked = false;
+    try {
+        alloc();
+    } catch (const Panic&) {
+        panicked = true;
+    }
+    assert_eq(panicked, true);
+}
+
+// targets: `free_run`.
+void test_free_run() {
+    constexpr usize num_data_blocks = BIT_PER_BLOCK * 2 - 256;
+
+    initialize(100, num_data_blocks);
+
+    OpContext ctx;
+    std::vector<usize> bno;
+    for (usize i = 0; i < num_data_blocks; i++) {
+        bcache.begin_op(&ctx);
+        bno.push_back(bcache.alloc(&ctx));
+        bcache.end_op(&ctx);
+    }
+
+    // a run across two bitmap blocks is freed at once, and the blocks can be
+    // allocated again.
+    constexpr usize first = BIT_PER_BLOCK / 2, num_blocks = BIT_PER_BLOCK;
+    assert_ne(bno[first] / BIT_PER_BLOCK, bno[first + num_blocks - 1] / BIT_PER_BLOCK);
+    bcache.begin_op(&ctx);
+    bcache.free_run(&ctx, bno[first], num_blocks);
+    bcache.end_op(&ctx);
+
+    for (usize i = 0; i < num_blocks; i++) {
+        bcache.begin_op(&ctx);
+        usize no = bcache.alloc(&ctx);
+        bcache.end_op(&ctx);
+        assert_true(no >= bno[first] && no < bno[first] + num_blocks);
+    }
+
+    bool panicked = false;
+    try {
+        bcache.begin_op(&ctx);
+        bcache.alloc(&ctx);
+    } catch (const Panic&) {
+        panicked = true;
+    }
+    assert_eq(panicked, true);
+}
+
+// targets: `alloc_near`.
+void test_alloc_near() {
+    initialize(100, 1000);
+
+    auto alloc_near = [](usize goal) {
+        OpContext ctx;
+        bcache.begin_op(&ctx);
+        usize no = bcache.alloc_near(&ctx, goal);
+        bcache.end_op(&ctx);
+        return no;
+    };
+
+    // two files appended to in turns get a run each.
+    usize a = alloc_near(0), b = alloc_near(0);
+    assert_eq(b, a + ALLOC_WINDOW_BLOCKS);
+    for (usize i = 1; i < ALLOC_WINDOW_BLOCKS; i++) {
+        assert_eq(alloc_near(a + i), a + i);
+        assert_eq(alloc_near(b + i), b + i);
+    }
+
+    // a run that bumps into another starts over after the last one.
+    usize c = alloc_near(a + ALLOC_WINDOW_BLOCKS);
+    assert_eq(c, b + ALLOC_WINDOW_BLOCKS);
+
+    // the new block is zeroed, as with `alloc`.
+    auto* d = mock.inspect(c);
+    for (usize i = 0; i < BLOCK_SIZE; i++) {
+        assert_eq(d[i], 0);
+    }
+}
+
+// targets: `alloc_data`, `acquire_new`.
+void test_alloc_data() {
+    initialize(100, 100);
+
+    std::vector<usize> reads;
+    mock.on_read = [&](usize bno, auto) { reads.push_back(bno); };
+
+    // a new block is written once with its data, and never read.
+    OpContext ctx;
+    bcache.begin_op(&ctx);
+    usize no = bcache.alloc_data(&ctx, 0);
+    auto* b = bcache.acquire_new(no);
+    for (usize i = 0; i < BLOCK_SIZE; i++) {
+        assert_eq(b->data[i], 0);
+    }
+    std::fill(b->data, b->data + BLOCK_SIZE, 0x66);
+    bcache.sync(&ctx, b);
+    bcache.release(b);
+    bcache.end_op(&ctx);
+
+    LogStats stats;
+    bcache.get_log_stats(&stats);
+    assert_eq(stats.num_log_writes, 2);  // the bitmap block and the data.
+    for (usize i = 0; i < BLOCK_SIZE; i++) {
+        assert_eq(mock.inspect(no)[i], 0x66);
+    }
+
+    // zeroing a block with `alloc` does not read it either.
+    bcache.begin_op(&ctx);
+    usize zeroed = bcache.alloc(&ctx);
+    bcache.end_op(&ctx);
+    for (usize i = 0; i < BLOCK_SIZE; i++) {
+        assert_eq(mock.inspect(zeroed)[i], 0);
+    }
+
+    assert_true(std::find(reads.begin(), reads.end(), no) == reads.end());
+    assert_true(std::find(reads.begin(), reads.end(), zeroed) == reads.end());
+}
+
+void test_read_ahead() {
+    constexpr usize num_blocks = 10;
+
+    initialize(1, num_blocks);
+
+    std::thread([] {
+        try {
+            bcache_reader();
+        } catch (const Offline&) {}
+    }).detach();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // hold the reader at its first read, so the rest of the blocks queue up.
+    usize t = sblock.num_blocks - num_blocks;
+    std::atomic<bool> reading = false, ready = false;
+    std::vector<u8*> buffers(num_blocks);
+    mock.on_read = [&](usize block_no, u8* buffer) {
+        if (block_no >= t)
+            buffers[block_no - t] = buffer;
+        reading = true;
+        while (!ready) {
+            std::this_thread::yield();
+        }
+    };
+
+    usize read_count = mock.read_count + num_blocks;
+    bcache.prefetch(t);
+    while (!reading) {
+        std::this_thread::yield();
+    }
+    for (usize i = 1; i < num_blocks; i++) {
+        bcache.prefetch(t + i);
+    }
+    ready = true;
+    for (usize i = 0; i < 100 && mock.read_count < read_count; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    assert_eq(mock.read_count, read_count);
+    assert_eq(mock.read_many_count, 2);
+
+    // prefetched blocks are ready, read straight into their buffers, and
+    // prefetching them again does nothing.
+    for (usize i = 0; i < num_blocks; i++) {
+        bcache.prefetch(t + i);
+        auto* b = bcache.acquire(t + i);
+        assert_eq(b->valid, true);
+        assert_eq(&b->data[0], buffers[i]);
+        assert_eq(b->data[0], mock.inspect(t + i)[0]);
+        bcache.release(b);
+    }
+    assert_eq(mock.read_count, read_count);
+}
+
+void test_group_commit() {
+    constexpr usize num_ops = 8;
+
+    initialize(OP_MAX_NUM_BLOCKS * 4, num_ops);
+
+    std::thread([] {
+        try {
+            bcache_committer();
+        } catch (const Offline&) {}
+    }).detach();
+
+    // let the committer take over from synchronous commits.
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    usize t = sblock.num_blocks - 1;
+    std::vector<u8> values;
+    for (usize i = 0; i < num_ops; i++) {
+        values.push_back(mock.inspect(t - i)[0]);
+    }
+
+    usize write_count = mock.write_count;
+    for (usize i = 0; i < num_ops; i++) {
+        OpContext ctx;
+        bcache.begin_op(&ctx);
+        auto* b = bcache.acquire(t - i);
+        b->data[0] = ~values[i];
+        bcache.sync(&ctx, b);
+        bcache.release(b);
+        bcache.end_op(&ctx);
+    }
+
+    // ended operations stay in memory until the barrier.
+    for (usize i = 0; i < num_ops; i++) {
+        assert_eq(mock.inspect(t - i)[0], values[i]);
+    }
+    assert_eq(mock.write_count, write_count);
+
+    // one transaction: every block is logged once, after its commit record.
+    // Home locations are left to checkpoint.
+    bcache.barrier();
+    auto* header = replayable_header();
+    assert_true(header != nullptr);
+    assert_eq(header->num_blocks, num_ops);
+    for (usize i = 0; i < num_ops; i++) {
+        assert_eq(header->block_no[i], t - i);
+        assert_eq(mock.inspect_log(1 + i)[0], (u8)~values[i]);
+    }
+    assert_eq(mock.write_count, write_count + num_ops + 1);
+    assert_eq(mock.write_many_count, 1);
+
+    // nothing to commit.
+    write_count = mock.write_count;
+    bcache.barrier();
+    assert_eq(mock.write_count, write_count);
+}
+
+void test_large_commit() {
+    // just enough operations to need a second descriptor block.
+    constexpr usize num_ops = LOG_HEADER_NUM_BLOCKS / OP_MAX_NUM_BLOCKS + 1;
+    constexpr usize num_blocks = num_ops * OP_MAX_NUM_BLOCKS;
+
+    initialize(LOG_MAX_SIZE + LOG_MAX_DESCRIPTORS, num_blocks);
+
+    std::thread([] {
+        try {
+            bcache_committer();
+        } catch (const Offline&) {}
+    }).detach();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    usize t = sblock.num_blocks - 1;
+    for (usize k = 0; k < num_ops; k++) {
+        OpContext ctx;
+        bcache.begin_op(&ctx);
+        for (usize i = k * OP_MAX_NUM_BLOCKS; i < (k + 1) * OP_MAX_NUM_BLOCKS; i++) {
+            auto* b = bcache.acquire(t - i);
+            b->data[0] = (u8)i;
+            bcache.sync(&ctx, b);
+            bcache.release(b);
+        }
+        bcache.end_op(&ctx);
+    }
+    bcache.barrier();
+
+    // the block numbers run on from the commit record into a descriptor block.
+    auto* header = replayable_header();
+    assert_true(header != nullptr);
+    assert_eq(header->num_blocks, num_blocks);
+    assert_eq(header->num_descriptors, 2);
+    auto* descriptor = reinterpret_cast<LogDescriptor*>(mock.inspect_log(1));
+    for (usize i = 0; i < num_blocks; i++) {
+        usize block_no = i < LOG_HEADER_NUM_BLOCKS
+                             ? header->block_no[i]
+                             : descriptor->block_no[i - LOG_HEADER_NUM_BLOCKS];
+        assert_eq(block_no, t - i);
+        assert_eq(mock.inspect_log(2 + i)[0], (u8)i);
+    }
+}
+
+void test_deferred_checkpoint() {
+    constexpr usize op_size = 3;
+    constexpr usize num_txns = 6;
+
+    initialize(LOG_MAX_SIZE, op_size);
+
+    std::thread([] {
+        try {
+            bcache_committer();
+        } catch (const Offline&) {}
+    }).detach();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    usize t = sblock.num_blocks - 1;
+    std::vector<u8> values;
+    for (usize i = 0; i < op_size; i++) {
+        values.push_back(mock.inspect(t - i)[0]);
+    }
+
+    for (usize k = 0; k < num_txns; k++) {
+        OpContext ctx;
+        bcache.begin_op(&ctx);
+        for (usize i = 0; i < op_size; i++) {
+            auto* b = bcache.acquire(t - i);
+            b->data[0] = (u8)(values[i] + k + 1);
+            bcache.sync(&ctx, b);
+            bcache.release(b);
+        }
+        bcache.end_op(&ctx);
+        bcache.barrier();
+    }
+
+    // every transaction is in the log, but no home location is written yet.
+    LogStats stats;
+    bcache.get_log_stats(&stats);
+    assert_eq(stats.num_commits, num_txns);
+    assert_eq(stats.num_log_writes, num_txns * op_size);
+    assert_eq(stats.num_home_writes, 0);
+    for (usize k = 0; k < num_txns; k++) {
+        auto* header = mock.inspect_log_header(k * (op_size + 1));
+        assert_eq(header->seq, mock.inspect_log_tail()->seq + k);
+        assert_eq(header->num_blocks, op_size);
+    }
+    for (usize i = 0; i < op_size; i++) {
+        assert_eq(mock.inspect(t - i)[0], values[i]);
+    }
+
+    // the flusher kicks in once the log is idle.
+    for (usize i = 0; i < CHECKPOINT_TIMEOUT_TICKS; i++) {
+        bcache_tick();
+    }
+    for (usize i = 0; i < 100 && stats.num_checkpoints == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        bcache.get_log_stats(&stats);
+    }
+
+    assert_eq(stats.num_checkpoints, 1);
+    assert_eq(stats.num_home_writes, op_size);
+    // checkpoints leave the log as it is.
+    assert_true(replayable_header() != nullptr);
+    for (usize i = 0; i < op_size; i++) {
+        assert_eq(mock.inspect(t - i)[0], (u8)(values[i] + num_txns));
+    }
+    printf("(trace) home writes: %zu deferred vs. %zu eager\n",
+           stats.num_home_writes,
+           num_txns * op_size);
+}
+
+void test_stats() {
+    initialize(100, 100);
+
+    usize t = sblock.num_blocks - 1;
+    CacheStats before, after;
+    bcache.get_cache_stats(&before);
+    for (usize i = 0; i < 2; i++) {
+        bcache.release(bcache.acquire(t));
+    }
+    bcache.get_cache_stats(&after);
+    assert_eq(after.num_misses - before.num_misses, 1);
+    assert_eq(after.num_hits - before.num_hits, 1);
+
+    // a full cache makes room for a new block.
+    bcache.set_capacity(after.num_cached);
+    bcache.release(bcache.acquire(t - 1));
+    bcache.get_cache_stats(&after);
+    assert_eq(after.num_evictions - before.num_evictions, 1);
+    bcache.set_capacity(EVICTION_THRESHOLD);
+
+    OpContext ctx;
+    bcache.begin_op(&ctx);
+    for (usize i = 0; i < 3; i++) {
+        auto* b = bcache.acquire(t - 2 - i);
+        b->data[0]++;
+        bcache.sync(&ctx, b);
+        bcache.release(b);
+    }
+    bcache.get_cache_stats(&after);
+    assert_eq(after.num_ops - before.num_ops, 1);
+    assert_eq(after.num_dirty, 3);
+    assert_eq(after.num_pinned, 3);
+    assert_eq(after.num_reserved, OP_MAX_NUM_BLOCKS);
+    bcache.end_op(&ctx);
+
+    // without committer, `end_op` checkpoints at once.
+    bcache.get_cache_stats(&after);
+    assert_eq(after.num_dirty, 0);
+    assert_eq(after.num_pinned, 0);
+    assert_eq(after.log.num_commits - before.log.num_commits, 1);
+    assert_eq(after.commit_size[2] - before.commit_size[2], 1);
+    usize num_timed = 0;
+    for (usize i = 0; i < CACHE_STATS_NUM_BUCKETS; i++) {
+        num_timed += after.commit_time[i] - before.commit_time[i];
+    }
+    assert_eq(num_timed, 1);
+}
+
 }  // namespace basic
 
 namespace concurrent {
@@ -576,6 +1522,37 @@ void test_sync() {
     }
 }
 
+void test_end_op() {
+    constexpr usize num_rounds = 5000;
+    constexpr usize num_workers = 16;
+
+    initialize(OP_MAX_NUM_BLOCKS * num_workers, num_workers);
+
+    // operations begin while others commit, and each one is on disk once
+    // its `end_op` returns.
+    std::vector<std::thread> workers;
+    for (usize i = 0; i < num_workers; i++) {
+        workers.emplace_back([i] {
+            usize t = sblock.num_blocks - 1 - i;
+            for (usize j = 0; j < num_rounds; j++) {
+                OpContext ctx;
+                bcache.begin_op_sized(&ctx, 1);
+                auto* b = bcache.acquire(t);
+                usize cookie = (i + 1) * num_rounds + j;
+                *reinterpret_cast<usize*>(b->data) = cookie;
+                bcache.sync(&ctx, b);
+                bcache.release(b);
+                bcache.end_op(&ctx);
+                assert_eq(*reinterpret_cast<usize*>(mock.inspect(t)), cookie);
+            }
+        });
+    }
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
 void test_alloc() {
     initialize(100, 1000);
 
@@ -661,13 +1638,25 @@ void test_simple_crash() {
     }
 }
 
+// each operation of a worker writes `v` to the first `num_bytes` bytes of its
+// blocks.
 void test_parallel(usize num_rounds,
                    usize num_workers,
                    usize delay_ms,
-                   usize log_cut) {
+                   usize log_cut,
+                   usize num_bytes = BLOCK_SIZE) {
     usize log_size = num_workers * OP_MAX_NUM_BLOCKS - log_cut;
     usize num_data_blocks = 200 + num_workers * OP_MAX_NUM_BLOCKS;
 
+    // number of committed atomic operations, shared with child processes.
+    auto* txn_count = static_cast<std::atomic<usize>*>(mmap(NULL,
+                                                            sizeof(std::atomic<usize>),
+                                                            PROT_READ | PROT_WRITE,
+                                                            MAP_SHARED | MAP_ANONYMOUS,
+                                                            -1,
+                                                            0));
+    new (txn_count) std::atomic<usize>(0);
+
     printf("(trace) running: 0/%zu", num_rounds);
     fflush(stdout);
 
@@ -695,16 +1684,17 @@ void test_parallel(usize num_rounds,
                             bcache.begin_op(&ctx);
                             for (usize j = 0; j < OP_MAX_NUM_BLOCKS; j++) {
                                 auto* b = bcache.acquire(t + j);
-                                for (usize k = 0; k < BLOCK_SIZE;
+                                for (usize k = 0; k < num_bytes;
                                      k += sizeof(u64)) {
                                     u64* p =
                                         reinterpret_cast<u64*>(b->data + k);
                                     *p = v;
                                 }
-                                bcache.sync(&ctx, b);
+                                bcache.sync_range(&ctx, b, 0, num_bytes);
                                 bcache.release(b);
                             }
                             bcache.end_op(&ctx);
+                            (*txn_count)++;
 
                             v++;
                         }
@@ -724,17 +1714,19 @@ void test_parallel(usize num_rounds,
 
             aha.join();
             mock.dump("sd.img");
-            exit(0);
+
+            // workers are still alive. Skip static destructors, which would
+            // tear down the lock mocks under their feet.
+            _exit(0);
         } else {
             wait_process(child);
             initialize_mock(log_size, num_data_blocks, "sd.img");
-            auto* header = mock.inspect_log_header();
-            if (header->num_blocks > 0)
+            if (replayable_header())
                 replay_count++;
 
             if ((child = fork()) == IN_CHILD) {
                 init_bcache(&sblock, &device);
-                assert_eq(header->num_blocks, 0);
+                assert_true(replayable_header() == nullptr);
 
                 for (usize i = 0; i < num_workers; i++) {
                     usize t = 200 + i * OP_MAX_NUM_BLOCKS;
@@ -744,7 +1736,7 @@ void test_parallel(usize num_rounds,
                         auto* b = mock.inspect(t + j);
                         for (usize k = 0; k < BLOCK_SIZE; k += sizeof(u64)) {
                             u64 u = *reinterpret_cast<u64*>(b + k);
-                            assert_eq(u, v);
+                            assert_eq(u, k < num_bytes ? v : 0);
                         }
                     }
                 }
@@ -759,6 +1751,153 @@ void test_parallel(usize num_rounds,
         fflush(stdout);
     }
 
+    printf("\n(trace) %zu workers: throughput = %.2f txn/s\n",
+           num_workers,
+           static_cast<double>(txn_count->load()) * 1000 / (num_rounds * delay_ms));
+    munmap(txn_count, sizeof(std::atomic<usize>));
+}
+
+// in `JOURNAL_ORDERED` mode, each worker writes file data and a record block
+// that stands for the metadata pointing to it. After a crash, the data is never
+// older than the record, and at most one transaction ahead of it.
+void test_ordered() {
+    constexpr usize num_rounds = 500;
+    constexpr usize num_workers = 2;
+    constexpr usize num_data = OP_MAX_NUM_BLOCKS - 1;
+    usize log_size = num_workers * OP_MAX_NUM_BLOCKS;
+    usize num_data_blocks = 200 + num_workers * OP_MAX_NUM_BLOCKS;
+
+    // a metadata block freed by a transaction that crashes before its commit
+    // record is still intact after replay, even if file data was written in
+    // place meanwhile.
+    int child;
+    if ((child = fork()) == IN_CHILD) {
+        initialize_mock(log_size, num_data_blocks);
+        usize t = sblock.num_blocks - 1;
+        auto* bitmap = mock.inspect(sblock.bitmap_start + t / BIT_PER_BLOCK);
+        bitmap[t % BIT_PER_BLOCK / 8] |= static_cast<u8>(1 << (t % 8));
+        std::fill_n(mock.inspect(t), BLOCK_SIZE, 0xab);
+
+        init_bcache(&sblock, &device);
+        bcache.set_journal_mode(JOURNAL_ORDERED);
+        mock.on_write = [&](usize block_no, auto) {
+            if (block_no > sblock.log_start && block_no < sblock.log_start + sblock.num_log_blocks)
+                mock.offline = true;
+        };
+
+        try {
+            OpContext ctx;
+            bcache.begin_op(&ctx);
+            bcache.free(&ctx, t);
+            auto* b = bcache.acquire_new(bcache.alloc_data(&ctx, t));
+            std::fill_n(b->data, BLOCK_SIZE, 0xcd);
+            bcache.sync_data(&ctx, b);
+            bcache.release(b);
+            bcache.end_op(&ctx);
+        } catch (const Offline&) {
+        }
+
+        mock.dump("sd.img");
+        _exit(0);
+    } else {
+        wait_process(child);
+        initialize_mock(log_size, num_data_blocks, "sd.img");
+
+        if ((child = fork()) == IN_CHILD) {
+            init_bcache(&sblock, &device);
+
+            auto* b = mock.inspect(sblock.num_blocks - 1);
+            for (usize i = 0; i < BLOCK_SIZE; i++) {
+                assert_eq(b[i], 0xab);
+            }
+
+            exit(0);
+        } else
+            wait_process(child);
+    }
+
+    printf("(trace) running: 0/%zu", num_rounds);
+    fflush(stdout);
+
+    for (usize round = 0; round < num_rounds; round++) {
+        int child;
+        if ((child = fork()) == IN_CHILD) {
+            initialize_mock(log_size, num_data_blocks);
+            for (usize i = 0; i < num_workers * OP_MAX_NUM_BLOCKS; i++) {
+                auto* b = mock.inspect(200 + i);
+                std::fill(b, b + BLOCK_SIZE, 0);
+            }
+
+            init_bcache(&sblock, &device);
+            bcache.set_journal_mode(JOURNAL_ORDERED);
+
+            std::atomic<bool> started = false;
+            for (usize i = 0; i < num_workers; i++) {
+                std::thread([&, i] {
+                    started = true;
+                    usize t = 200 + i * OP_MAX_NUM_BLOCKS;
+                    try {
+                        for (u64 v = 1;; v++) {
+                            OpContext ctx;
+                            bcache.begin_op(&ctx);
+                            for (usize j = 0; j <= num_data; j++) {
+                                auto* b = bcache.acquire(t + j);
+                                for (usize k = 0; k < BLOCK_SIZE; k += sizeof(u64)) {
+                                    *reinterpret_cast<u64*>(b->data + k) = v;
+                                }
+                                if (j < num_data)
+                                    bcache.sync_data(&ctx, b);
+                                else
+                                    bcache.sync(&ctx, b);
+                                bcache.release(b);
+                            }
+                            bcache.end_op(&ctx);
+                        }
+                    } catch (const Offline&) {
+                    }
+                }).detach();
+            }
+
+            std::thread aha([&] {
+                while (!started) {
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                mock.offline = true;
+            });
+
+            aha.join();
+            mock.dump("sd.img");
+            _exit(0);
+        } else {
+            wait_process(child);
+            initialize_mock(log_size, num_data_blocks, "sd.img");
+
+            if ((child = fork()) == IN_CHILD) {
+                init_bcache(&sblock, &device);
+
+                for (usize i = 0; i < num_workers; i++) {
+                    usize t = 200 + i * OP_MAX_NUM_BLOCKS;
+                    auto* record = mock.inspect(t + num_data);
+                    u64 r = *reinterpret_cast<u64*>(record);
+                    for (usize k = 0; k < BLOCK_SIZE; k += sizeof(u64)) {
+                        assert_eq(*reinterpret_cast<u64*>(record + k), r);
+                    }
+
+                    for (usize j = 0; j < num_data; j++) {
+                        auto* b = mock.inspect(t + j);
+                        u64 v = *reinterpret_cast<u64*>(b);
+                        assert_true(r <= v && v <= r + 1);
+                    }
+                }
+
+                exit(0);
+            } else
+                wait_process(child);
+        }
+
+        printf("\r(trace) running: %zu/%zu", round + 1, num_rounds);
+        fflush(stdout);
+    }
     puts("");
 }
 
@@ -860,12 +1999,14 @@ void test_banker() {
             fflush(stdout);
 
             mock.dump("sd.img");
-            exit(0);
+
+            // workers are still alive. Skip static destructors, which would
+            // tear down the lock mocks under their feet.
+            _exit(0);
         } else {
             wait_process(child);
             initialize_mock(log_size, num_accounts, "sd.img");
-            auto* header = mock.inspect_log_header();
-            if (header->num_blocks > 0)
+            if (replayable_header())
                 replay_count++;
 
             if ((child = fork()) == IN_CHILD) {
@@ -902,17 +2043,37 @@ int main() {
         {"loop_read", basic::test_loop_read},
         {"reuse", basic::test_reuse},
         {"lru", basic::test_lru},
+        {"scan_resistance", basic::test_scan_resistance},
+        {"capacity", basic::test_capacity},
+        {"buffer_layout", basic::test_buffer_layout},
+        {"memory_pressure", basic::test_memory_pressure},
         {"atomic_op", basic::test_atomic_op},
         {"overflow", basic::test_overflow},
+        {"reservation", basic::test_reservation},
+        {"read_only_op", basic::test_read_only_op},
+        {"ordered_data", basic::test_ordered_data},
         {"resident", basic::test_resident},
         {"local_absorption", basic::test_local_absorption},
         {"global_absorption", basic::test_global_absorption},
+        {"delta_log", basic::test_delta_log},
         {"replay", basic::test_replay},
+        {"replay_delta", basic::test_replay_delta},
+        {"replay_large", basic::test_replay_large},
         {"alloc", basic::test_alloc},
         {"alloc_free", basic::test_alloc_free},
+        {"alloc_next_fit", basic::test_alloc_next_fit},
+        {"free_run", basic::test_free_run},
+        {"alloc_near", basic::test_alloc_near},
+        {"alloc_data", basic::test_alloc_data},
+        {"read_ahead", basic::test_read_ahead},
+        {"group_commit", basic::test_group_commit},
+        {"large_commit", basic::test_large_commit},
+        {"deferred_checkpoint", basic::test_deferred_checkpoint},
+        {"stats", basic::test_stats},
 
         {"concurrent_acquire", concurrent::test_acquire},
         {"concurrent_sync", concurrent::test_sync},
+        {"concurrent_end_op", concurrent::test_end_op},
         {"concurrent_alloc", concurrent::test_alloc},
 
         {"simple_crash", crash::test_simple_crash},
@@ -922,6 +2083,8 @@ int main() {
         {"parallel_3", [] { crash::test_parallel(500, 4, 10, 1); }},
         {"parallel_4",
          [] { crash::test_parallel(500, 4, 10, 2 * OP_MAX_NUM_BLOCKS); }},
+        {"parallel_delta", [] { crash::test_parallel(500, 4, 10, 0, 16); }},
+        {"ordered", crash::test_ordered},
         {"banker", crash::test_banker},
     };
     Runner(tests).run();
@@ -8,6 +8,9 @@ extern "C" {
 
 #include "mock/cache.hpp"
 
+#include <algorithm>
+#include <map>
+
 void test_init() {
     init_inodes(&sblock, &cache);
     assert_eq(mock.count_inodes(), 1);
@@ -47,7 +50,7 @@ void test_sync() {
     assert_eq(p->entry.type, INODE_DIRECTORY);
     p->entry.major = 0x19;
     p->entry.minor = 0x26;
-    p->entry.indirect = 0xa817;
+    p->entry.extents[0].block_no = 0xa817;
     inodes.unlock(p);
 
     mock.begin_op(ctx);
@@ -61,7 +64,7 @@ void test_sync() {
     assert_eq(q->type, INODE_DIRECTORY);
     assert_eq(q->major, 0x19);
     assert_eq(q->minor, 0x26);
-    assert_eq(q->indirect, 0xa817);
+    assert_eq(q->extents[0].block_no, 0xa817);
 }
 
 void test_touch() {
@@ -80,9 +83,10 @@ void test_touch() {
         assert_eq(q->entry.minor, 0);
         assert_eq(q->entry.num_links, 0);
         assert_eq(q->entry.num_bytes, 0);
-        assert_eq(q->entry.indirect, 0);
-        for (usize j = 0; j < INODE_NUM_DIRECT; j++) {
-            assert_eq(q->entry.addrs[j], 0);
+        assert_eq(q->entry.num_extents, 0);
+        assert_eq(q->entry.depth, 0);
+        for (usize j = 0; j < INODE_NUM_EXTENTS; j++) {
+            assert_eq(q->entry.extents[j].block_no, 0);
         }
 
         q->entry.num_links++;
@@ -195,9 +199,10 @@ void test_small_file() {
     mock.end_op(ctx);
 
     auto* q = mock.inspect(ino);
-    assert_eq(q->indirect, 0);
-    assert_ne(q->addrs[0], 0);
-    assert_eq(q->addrs[1], 0);
+    assert_eq(q->num_extents, 1);
+    assert_eq(q->depth, 0);
+    assert_ne(q->extents[0].block_no, 0);
+    assert_eq(q->extents[0].num_blocks, 1);
     assert_eq(q->num_bytes, 1);
     assert_eq(mock.count_blocks(), 1);
 
@@ -215,8 +220,8 @@ void test_small_file() {
     mock.end_op(ctx);
 
     q = mock.inspect(ino);
-    assert_eq(q->indirect, 0);
-    assert_eq(q->addrs[0], 0);
+    assert_eq(q->num_extents, 0);
+    assert_eq(q->extents[0].block_no, 0);
     assert_eq(q->num_bytes, 0);
     assert_eq(mock.count_blocks(), 0);
 
@@ -334,7 +339,7 @@ void test_dir() {
     inodes.sync(ctx, p[1], true);
 
     auto* q = mock.inspect(ino[0]);
-    assert_eq(q->addrs[0], 0);
+    assert_eq(q->extents[0].block_no, 0);
     assert_eq(inodes.lookup(p[0], "fudan", NULL), ino[1]);
     mock.end_op(ctx);
 
@@ -381,12 +386,12 @@ void test_dir() {
     inodes.sync(ctx, p[2], true);
 
     q = mock.inspect(ino[1]);
-    assert_ne(q->addrs[0], 0);
+    assert_ne(q->extents[0].block_no, 0);
     assert_eq(inodes.lookup(p[1], "alice", NULL), 0);
     assert_eq(inodes.lookup(p[1], "bob", NULL), 0);
     mock.end_op(ctx);
 
-    assert_eq(q->addrs[0], 0);
+    assert_eq(q->extents[0].block_no, 0);
     assert_eq(mock.count_inodes(), 5);
     assert_ne(mock.count_blocks(), 0);
 
@@ -399,6 +404,415 @@ void test_dir() {
     }
 }
 
+// append the block numbers mapped by `n` entries of an extent tree `depth`
+// levels above the extents to `blocks`, and the tree nodes to `nodes`.
+void walk_extents(const Extent* entries,
+                  usize n,
+                  usize depth,
+                  std::vector<usize>& blocks,
+                  std::vector<usize>& nodes) {
+    for (usize i = 0; i < n; i++) {
+        if (depth == 0) {
+            for (usize j = 0; j < entries[i].num_blocks; j++) {
+                blocks.push_back(entries[i].block_no + j);
+            }
+            continue;
+        }
+        nodes.push_back(entries[i].block_no);
+        auto* b = cache.acquire(entries[i].block_no);
+        auto* node = reinterpret_cast<ExtentNode*>(b->data);
+        assert_eq(node->depth, depth - 1);
+        walk_extents(node->entries, node->num_entries, depth - 1, blocks, nodes);
+        cache.release(b);
+    }
+}
+
+// return the block numbers of a file on disk, in order.
+auto get_blocks(const InodeEntry* q) -> std::vector<usize> {
+    std::vector<usize> blocks, nodes;
+    walk_extents(q->extents, q->num_extents, q->depth, blocks, nodes);
+    return blocks;
+}
+
+void test_read_ahead() {
+    constexpr usize num_blocks = 20;
+
+    mock.begin_op(ctx);
+    usize ino = inodes.alloc(ctx, INODE_REGULAR);
+    mock.end_op(ctx);
+
+    auto* p = inodes.get(ino);
+    static u8 buf[num_blocks * BLOCK_SIZE];
+
+    inodes.lock(p);
+    mock.begin_op(ctx);
+    inodes.write(ctx, p, buf, 0, sizeof(buf));
+    mock.end_op(ctx);
+
+    auto addrs = get_blocks(mock.inspect(ino));
+    assert_eq(addrs.size(), num_blocks);
+
+    // every block of a sequential read is prefetched once, before it is read.
+    for (usize i = 0; i < num_blocks; i++) {
+        auto& list = mock.prefetched;
+        if (i > 0)
+            assert_true(std::find(list.begin(), list.end(), addrs[i]) != list.end());
+        inodes.read(p, buf, i * BLOCK_SIZE, BLOCK_SIZE);
+    }
+    assert_eq(mock.prefetched.size(), num_blocks - 1);
+
+    // random reads do not prefetch.
+    usize n = mock.prefetched.size();
+    for (usize i = num_blocks; i >= 2; i -= 2) {
+        inodes.read(p, buf, (i - 1) * BLOCK_SIZE, 1);
+    }
+    assert_eq(mock.prefetched.size(), n);
+    inodes.unlock(p);
+
+    mock.begin_op(ctx);
+    inodes.put(ctx, p);
+    mock.end_op(ctx);
+}
+
+void test_alloc_goal() {
+    constexpr usize num_blocks = INODE_NUM_EXTENTS + 4;
+
+    mock.begin_op(ctx);
+    usize ino = inodes.alloc(ctx, INODE_REGULAR);
+    mock.end_op(ctx);
+
+    auto* p = inodes.get(ino);
+    static u8 buf[BLOCK_SIZE];
+
+    // a file appended block by block asks for the block after its previous one,
+    // even if other files allocate in between.
+    inodes.lock(p);
+    mock.goals.clear();
+    for (usize i = 0; i < num_blocks; i++) {
+        mock.begin_op(ctx);
+        inodes.write(ctx, p, buf, i * BLOCK_SIZE, BLOCK_SIZE);
+        mock.alloc(ctx);
+        mock.end_op(ctx);
+    }
+
+    // every block is an extent of its own, so the extents outgrow the inode
+    // once, which moves them down into one new leaf and starts another.
+    auto* q = mock.inspect(ino);
+    assert_eq(q->depth, 1);
+    assert_eq(q->num_extents, 2);
+    std::vector<usize> addrs, nodes;
+    walk_extents(q->extents, q->num_extents, q->depth, addrs, nodes);
+    assert_eq(addrs.size(), num_blocks);
+
+    // one goal per data block, and one per new node, right after the block
+    // allocated before it.
+    std::vector<usize> expected = {0};
+    for (usize i = 1; i < num_blocks; i++) {
+        expected.push_back(addrs[i - 1] + 1);
+        if (i == INODE_NUM_EXTENTS) {
+            expected.push_back(addrs[i] + 1);
+            expected.push_back(nodes[0] + 1);
+        }
+    }
+    assert_true(mock.goals == expected);
+    inodes.unlock(p);
+
+    mock.begin_op(ctx);
+    inodes.put(ctx, p);
+    mock.end_op(ctx);
+}
+
+void test_extent_tree() {
+    constexpr usize num_blocks = INODE_NUM_EXTENTS * EXTENT_NODE_SIZE + 8;
+
+    mock.begin_op(ctx);
+    usize ino = inodes.alloc(ctx, INODE_REGULAR);
+    mock.end_op(ctx);
+
+    auto* p = inodes.get(ino);
+    static u8 buf[num_blocks * BLOCK_SIZE], copy[num_blocks * BLOCK_SIZE];
+    std::mt19937 gen(0xdeadbeef);
+    for (usize i = 0; i < sizeof(buf); i++) {
+        copy[i] = buf[i] = gen() & 0xff;
+    }
+
+    // a file written at once is one extent.
+    inodes.lock(p);
+    mock.begin_op(ctx);
+    inodes.write(ctx, p, buf, 0, sizeof(buf));
+    mock.end_op(ctx);
+
+    auto* q = mock.inspect(ino);
+    assert_eq(q->num_extents, 1);
+    assert_eq(q->depth, 0);
+    assert_eq(q->extents[0].num_blocks, num_blocks);
+
+    mock.begin_op(ctx);
+    inodes.clear(ctx, p);
+    mock.end_op(ctx);
+    assert_eq(mock.count_blocks(), 0);
+
+    // interleaved allocations split it into one extent per block, which takes
+    // two levels of nodes.
+    for (usize i = 0; i < num_blocks; i++) {
+        mock.begin_op(ctx);
+        inodes.write(ctx, p, buf + i * BLOCK_SIZE, i * BLOCK_SIZE, BLOCK_SIZE);
+        mock.alloc(ctx);
+        mock.end_op(ctx);
+    }
+
+    mock.fill_junk();
+    for (usize i = 0; i < sizeof(buf); i++) {
+        buf[i] = 0;
+    }
+    inodes.read(p, buf, 0, sizeof(buf));
+    for (usize i = 0; i < sizeof(buf); i++) {
+        assert_eq(buf[i], copy[i]);
+    }
+    for (usize i = num_blocks; i > 0; i--) {
+        u8 x;
+        inodes.read(p, &x, (i - 1) * BLOCK_SIZE + 7, 1);
+        assert_eq(x, copy[(i - 1) * BLOCK_SIZE + 7]);
+    }
+
+    q = mock.inspect(ino);
+    assert_eq(q->depth, 2);
+    std::vector<usize> blocks, nodes;
+    walk_extents(q->extents, q->num_extents, q->depth, blocks, nodes);
+    assert_eq(blocks.size(), num_blocks);
+    assert_eq(mock.count_blocks(), 2 * num_blocks + nodes.size());
+
+    // clearing frees the nodes too.
+    mock.begin_op(ctx);
+    inodes.clear(ctx, p);
+    mock.end_op(ctx);
+    assert_eq(mock.count_blocks(), num_blocks);
+    inodes.unlock(p);
+
+    mock.begin_op(ctx);
+    inodes.put(ctx, p);
+    mock.end_op(ctx);
+}
+
+void test_dir_index() {
+    constexpr usize num_entries = 600;
+
+    mock.begin_op(ctx);
+    usize ino = inodes.alloc(ctx, INODE_DIRECTORY);
+    mock.end_op(ctx);
+
+    auto* p = inodes.get(ino);
+    auto name = [](usize i) { return "f" + std::to_string(i); };
+    std::map<std::string, std::pair<usize, usize>> expected;
+    auto check = [&] {
+        for (auto& [key, value] : expected) {
+            usize index = 0;
+            assert_eq(inodes.lookup(p, key.data(), &index), value.first);
+            if (value.first != 0)
+                assert_eq(index, value.second);
+        }
+    };
+    auto insert = [&](usize i) {
+        usize index = inodes.insert(ctx, p, name(i).data(), 2 + i % 900);
+        expected[name(i)] = {2 + i % 900, index};
+        return index;
+    };
+
+    // entries are appended to a new directory, which gets an index once it
+    // takes a few blocks.
+    inodes.lock(p);
+    mock.begin_op(ctx);
+    for (usize i = 0; i < num_entries; i++) {
+        assert_eq(insert(i), i * sizeof(DirEntry));
+    }
+    assert_eq(inodes.insert(ctx, p, name(7).data(), 1), static_cast<usize>(-1));
+    mock.end_op(ctx);
+    assert_ne(p->dir_index, nullptr);
+    check();
+
+    // removed entries are not found, and their slots are taken again first.
+    mock.begin_op(ctx);
+    for (usize i = 0; i < num_entries; i += 3) {
+        usize index;
+        assert_ne(inodes.lookup(p, name(i).data(), &index), 0);
+        inodes.remove(ctx, p, index);
+        expected[name(i)].first = 0;
+    }
+    mock.end_op(ctx);
+    check();
+
+    mock.begin_op(ctx);
+    for (usize i = num_entries; i < num_entries + num_entries / 3; i++) {
+        assert_eq(insert(i) % (3 * sizeof(DirEntry)), 0);
+    }
+    mock.end_op(ctx);
+    assert_eq(p->entry.num_bytes, num_entries * sizeof(DirEntry));
+    check();
+
+    // the index grows with the directory.
+    mock.begin_op(ctx);
+    for (usize i = 2 * num_entries; i < 8 * num_entries; i++) {
+        insert(i);
+    }
+    p->entry.num_links = 1;
+    inodes.sync(ctx, p, true);
+    mock.end_op(ctx);
+    assert_eq(p->entry.num_bytes, 7 * num_entries * sizeof(DirEntry));
+    assert_ne(p->dir_index, nullptr);
+    mock.fill_junk();
+    check();
+    inodes.unlock(p);
+
+    // the index is kept once the inode leaves memory, and comes back with it.
+    auto* dir_index = p->dir_index;
+    std::vector<usize> others;
+    mock.begin_op(ctx);
+    inodes.put(ctx, p);
+    for (usize i = 0; i < INODE_CACHE_SIZE; i++) {
+        others.push_back(inodes.alloc(ctx, INODE_REGULAR));
+        auto* q = inodes.get(others[i]);
+        inodes.lock(q);
+        q->entry.num_links = 1;
+        inodes.sync(ctx, q, true);
+        inodes.unlock(q);
+        inodes.put(ctx, q);
+    }
+    mock.end_op(ctx);
+    mock.inspect(ino)->major = 0x2333;
+    p = inodes.get(ino);
+    assert_eq(p->entry.major, 0x2333);
+    assert_eq(p->dir_index, dir_index);
+    inodes.lock(p);
+    check();
+
+    mock.begin_op(ctx);
+    p->entry.num_links = 0;
+    inodes.unlock(p);
+    inodes.put(ctx, p);
+    for (usize i : others) {
+        auto* q = inodes.get(i);
+        inodes.lock(q);
+        q->entry.num_links = 0;
+        inodes.unlock(q);
+        inodes.put(ctx, q);
+    }
+    mock.end_op(ctx);
+}
+
+void test_dentry_cache() {
+    mock.begin_op(ctx);
+    usize ino[2] = {inodes.alloc(ctx, INODE_DIRECTORY), inodes.alloc(ctx, INODE_REGULAR)};
+    mock.end_op(ctx);
+
+    Inode* p[2];
+    mock.begin_op(ctx);
+    for (usize i = 0; i < 2; i++) {
+        p[i] = inodes.get(ino[i]);
+        inodes.lock(p[i]);
+        p[i]->entry.num_links++;
+        inodes.sync(ctx, p[i], true);
+        inodes.unlock(p[i]);
+    }
+    inodes.lock(inodes.root);
+    inodes.insert(ctx, inodes.root, "dir", ino[0]);
+    inodes.unlock(inodes.root);
+    mock.end_op(ctx);
+
+    auto resolve = [](const char* path) {
+        mock.begin_op(ctx);
+        auto* ip = namei(path, ctx);
+        usize inode_no = ip ? ip->inode_no : 0;
+        if (ip)
+            inodes.put(ctx, ip);
+        mock.end_op(ctx);
+        return inode_no;
+    };
+    auto update = [&](auto&& fn) {
+        inodes.lock(p[0]);
+        mock.begin_op(ctx);
+        fn();
+        mock.end_op(ctx);
+        inodes.unlock(p[0]);
+    };
+
+    // a missing name is cached until it is inserted.
+    assert_eq(resolve("/dir/file"), 0);
+    assert_eq(resolve("/dir/file"), 0);
+    usize index;
+    update([&] { index = inodes.insert(ctx, p[0], "file", ino[1]); });
+    assert_eq(resolve("/dir/file"), ino[1]);
+
+    // a cached name is not read from the directory again, until it is
+    // evicted by newer ones.
+    DirEntry de = {ROOT_INODE_NO, "file"};
+    update([&] { inodes.write(ctx, p[0], reinterpret_cast<u8*>(&de), index, sizeof(de)); });
+    assert_eq(resolve("/dir/file"), ino[1]);
+    for (usize i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        assert_eq(resolve(("/dir/x" + std::to_string(i)).data()), 0);
+    }
+    assert_eq(resolve("/dir/file"), ROOT_INODE_NO);
+
+    // a removed name is gone.
+    update([&] { inodes.remove(ctx, p[0], index); });
+    assert_eq(resolve("/dir/file"), 0);
+    assert_eq(resolve("/dir"), ino[0]);
+    assert_eq(resolve("/dir/"), ino[0]);
+    assert_eq(resolve("/file"), 0);
+
+    mock.begin_op(ctx);
+    inodes.put(ctx, p[0]);
+    inodes.put(ctx, p[1]);
+    mock.end_op(ctx);
+}
+
+void test_inode_cache() {
+    constexpr usize num_inodes = INODE_CACHE_SIZE + 1;
+
+    std::vector<usize> ino;
+    mock.begin_op(ctx);
+    for (usize i = 0; i < num_inodes; i++) {
+        ino.push_back(inodes.alloc(ctx, INODE_REGULAR));
+        auto* p = inodes.get(ino[i]);
+        inodes.lock(p);
+        p->entry.num_links = 1;
+        inodes.sync(ctx, p, true);
+        inodes.unlock(p);
+        inodes.put(ctx, p);
+    }
+    mock.end_op(ctx);
+    std::reverse(ino.begin(), ino.end());
+
+    // an unused inode is got again from memory, so a change on disk behind
+    // its back goes unnoticed.
+    mock.inspect(ino[0])->major = 0x2333;
+    auto* p = inodes.get(ino[0]);
+    assert_eq(p->entry.major, 0);
+    assert_eq(inodes.get(ino[0]), p);
+    mock.begin_op(ctx);
+    inodes.put(ctx, p);
+    inodes.put(ctx, p);
+    mock.end_op(ctx);
+
+    // it is read again once enough other inodes have been used since.
+    mock.begin_op(ctx);
+    for (usize i = 1; i < num_inodes; i++) {
+        inodes.put(ctx, inodes.get(ino[i]));
+    }
+    mock.end_op(ctx);
+    p = inodes.get(ino[0]);
+    assert_eq(p->entry.major, 0x2333);
+
+    // an inode whose last link is gone is freed, not cached.
+    mock.begin_op(ctx);
+    inodes.lock(p);
+    p->entry.num_links = 0;
+    inodes.unlock(p);
+    usize num_used = mock.count_inodes();
+    inodes.put(ctx, p);
+    mock.end_op(ctx);
+    assert_eq(mock.count_inodes(), num_used - 1);
+}
+
 }  // namespace adhoc
 
 int main() {
@@ -415,6 +829,12 @@ int main() {
         {"small_file", adhoc::test_small_file},
         {"large_file", adhoc::test_large_file},
         {"dir", adhoc::test_dir},
+        {"read_ahead", adhoc::test_read_ahead},
+        {"alloc_goal", adhoc::test_alloc_goal},
+        {"extent_tree", adhoc::test_extent_tree},
+        {"dir_index", adhoc::test_dir_index},
+        {"dentry_cache", adhoc::test_dentry_cache},
+        {"inode_cache", adhoc::test_inode_cache},
     };
     Runner(tests).run();
 
@@ -26,7 +26,9 @@ void *kalloc() {
 }
 
 void kfree(void *ptr) {
-    free(ref[reinterpret_cast<u8 *>(ptr)]);
+    auto *q = reinterpret_cast<u8 *>(ptr);
+    free(ref[q]);
+    ref.remove(q);
 }
 
 void init_arena(Arena *arena, usize object_size, ArenaPageAllocator allocator [[maybe_unused]]) {
@@ -40,4 +42,8 @@ void *alloc_object(Arena *arena) {
 void free_object(void *object) {
     free(object);
 }
+
+usize shrink_arena(struct Arena *arena [[maybe_unused]]) {
+    return 0;
+}
 }
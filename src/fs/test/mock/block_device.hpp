@@ -37,6 +37,8 @@ struct MockBlockDevice {
     std::atomic<bool> offline;
     std::atomic<usize> read_count;
     std::atomic<usize> write_count;
+    std::atomic<usize> read_many_count;   // number of multi-block reads.
+    std::atomic<usize> write_many_count;  // number of multi-block writes.
     std::vector<Block> disk;
 
     using Hook = std::function<void(usize block_no, u8 *buffer)>;
@@ -50,6 +52,8 @@ struct MockBlockDevice {
         offline = false;
         read_count = 0;
         write_count = 0;
+        read_many_count = 0;
+        write_many_count = 0;
         {
             std::vector<Block> new_disk(sblock->num_blocks);
             std::swap(disk, new_disk);
@@ -89,8 +93,12 @@ struct MockBlockDevice {
         return inspect(sblock->log_start + 1 + index);
     }
 
-    auto inspect_log_header() -> LogHeader * {
-        return reinterpret_cast<LogHeader *>(inspect(sblock->log_start));
+    auto inspect_log_tail() -> LogTail * {
+        return reinterpret_cast<LogTail *>(inspect(sblock->log_start));
+    }
+
+    auto inspect_log_header(usize index) -> LogHeader * {
+        return reinterpret_cast<LogHeader *>(inspect_log(index));
     }
 
     void dump(std::ostream &stream) {
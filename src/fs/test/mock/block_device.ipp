@@ -14,23 +14,42 @@ static void stub_write(usize block_no, u8 *buffer) {
     mock.write(block_no, buffer);
 }
 
+static void stub_read_many(usize block_no, usize count, u8 **buffers) {
+    mock.read_many_count++;
+    for (usize i = 0; i < count; i++) {
+        mock.read(block_no + i, buffers[i]);
+    }
+}
+
+static void stub_write_many(usize block_no, usize count, u8 **buffers) {
+    mock.write_many_count++;
+    for (usize i = 0; i < count; i++) {
+        mock.write(block_no + i, buffers[i]);
+    }
+}
+
 static void initialize_mock(  //
     usize log_size,
     usize num_data_blocks,
     const std::string &image_path = "") {
+    // `log_size` blocks are left for the content of a transaction, after
+    // `LogTail` and its commit record. Larger transactions need more
+    // descriptor blocks, see `LOG_NUM_DESCRIPTORS`.
     sblock.log_start = 2;
-    sblock.inode_start = sblock.log_start + 1 + log_size;
+    sblock.inode_start = sblock.log_start + 2 + log_size;
     sblock.bitmap_start = sblock.inode_start + 1;
     sblock.num_inodes = 1;
-    sblock.num_log_blocks = 1 + log_size;
+    sblock.num_log_blocks = 2 + log_size;
     sblock.num_data_blocks = num_data_blocks;
-    sblock.num_blocks = 1 + 1 + 1 + log_size + 1 +
+    sblock.num_blocks = 1 + 1 + 2 + log_size + 1 +
                         ((num_data_blocks + BIT_PER_BLOCK - 1) / BIT_PER_BLOCK) + num_data_blocks;
 
     mock.initialize(sblock);
 
     device.read = stub_read;
     device.write = stub_write;
+    device.read_many = stub_read_many;
+    device.write_many = stub_write_many;
 
     if (!image_path.empty())
         mock.load(image_path);
@@ -4,11 +4,13 @@ extern "C" {
 #include <fs/inode.h>
 }
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <random>
 #include <unordered_map>
+#include <vector>
 
 #include "../exception.hpp"
 
@@ -46,9 +48,16 @@ struct MockBlockCache {
         usize index;
         std::mutex mutex;
         Block block;
+        u8 data[BLOCK_SIZE];
+
+        Cell() {
+            block.data = data;
+        }
 
         auto operator=(const Cell &rhs) -> Cell & {
             block = rhs.block;
+            block.data = data;
+            std::copy(rhs.data, rhs.data + BLOCK_SIZE, data);
             return *this;
         }
 
@@ -82,6 +91,14 @@ struct MockBlockCache {
     Meta mbit[num_blocks], sbit[num_blocks];
     Cell mblk[num_blocks], sblk[num_blocks];
 
+    // prefetched: block numbers passed to `prefetch`, in order.
+    std::mutex prefetch_mutex;
+    std::vector<usize> prefetched;
+
+    // goals: goals passed to `alloc_near`, in order.
+    std::mutex goal_mutex;
+    std::vector<usize> goals;
+
     MockBlockCache() {
         std::mt19937 gen(0x19260817);
 
@@ -113,10 +130,12 @@ struct MockBlockCache {
             node[i].minor = gen() & 0xffff;
             node[i].num_links = gen() & 0xffff;
             node[i].num_bytes = gen() & 0xffff;
-            for (usize j = 0; j < INODE_NUM_DIRECT; j++) {
-                node[i].addrs[j] = gen();
+            node[i].num_extents = gen() & 0xffff;
+            node[i].depth = gen() & 0xffff;
+            for (usize j = 0; j < INODE_NUM_EXTENTS; j++) {
+                node[i].extents[j] = {static_cast<u32>(gen()), static_cast<u32>(gen()),
+                                      static_cast<u32>(gen())};
             }
-            node[i].indirect = gen();
         }
 
         // mock root inode.
@@ -125,10 +144,11 @@ struct MockBlockCache {
         node[1].minor = 0;
         node[1].num_links = 1;
         node[1].num_bytes = 0;
-        for (usize i = 0; i < INODE_NUM_DIRECT; i++) {
-            node[1].addrs[i] = 0;
+        node[1].num_extents = 0;
+        node[1].depth = 0;
+        for (usize i = 0; i < INODE_NUM_EXTENTS; i++) {
+            node[1].extents[i] = {0, 0, 0};
         }
-        node[1].indirect = 0;
 
         usize step = 0;
         for (usize i = 0, j = inode_start; i < num_inodes; i += step, j++) {
@@ -234,6 +254,7 @@ struct MockBlockCache {
     void begin_op(OpContext *ctx) {
         std::unique_lock lock(mutex);
         ctx->ts = oracle.fetch_add(1);
+        ctx->read_only = false;
         scoreboard[ctx->ts] = false;
     }
 
@@ -272,29 +293,46 @@ struct MockBlockCache {
         }
     }
 
-    auto alloc(OpContext *ctx) -> usize {
-        for (usize i = block_start; i < num_blocks; i++) {
-            std::scoped_lock guard(mbit[i].mutex, sbit[i].mutex);
-            load(mbit[i], sbit[i]);
+    // allocate block `i` if it is free.
+    auto take(OpContext *ctx, usize i) -> bool {
+        std::scoped_lock guard(mbit[i].mutex, sbit[i].mutex);
+        load(mbit[i], sbit[i]);
 
-            if (!mbit[i].used) {
-                mbit[i].used = true;
-                if (!ctx)
-                    store(mbit[i], sbit[i]);
+        if (mbit[i].used)
+            return false;
 
-                std::scoped_lock guard(mblk[i].mutex, sblk[i].mutex);
-                load(mblk[i], sblk[i]);
-                mblk[i].zero();
-                if (!ctx)
-                    store(mblk[i], sblk[i]);
+        mbit[i].used = true;
+        if (!ctx)
+            store(mbit[i], sbit[i]);
+
+        std::scoped_lock guard_blk(mblk[i].mutex, sblk[i].mutex);
+        load(mblk[i], sblk[i]);
+        mblk[i].zero();
+        if (!ctx)
+            store(mblk[i], sblk[i]);
+
+        return true;
+    }
 
+    auto alloc(OpContext *ctx) -> usize {
+        for (usize i = block_start; i < num_blocks; i++) {
+            if (take(ctx, i))
                 return i;
-            }
         }
 
         throw AssertionFailure("no free block");
     }
 
+    auto alloc_near(OpContext *ctx, usize goal) -> usize {
+        {
+            std::scoped_lock lock(goal_mutex);
+            goals.push_back(goal);
+        }
+        if (goal >= block_start && goal < num_blocks && take(ctx, goal))
+            return goal;
+        return alloc(ctx);
+    }
+
     void free(OpContext *ctx, usize i) {
         check_block_no(i);
 
@@ -321,6 +359,12 @@ struct MockBlockCache {
         return &mblk[i].block;
     }
 
+    void prefetch(usize i) {
+        check_block_no(i);
+        std::scoped_lock lock(prefetch_mutex);
+        prefetched.push_back(i);
+    }
+
     void release(Block *b) {
         auto *p = check_and_get_cell(b);
         p->mutex.unlock();
@@ -10,6 +10,16 @@ static void stub_begin_op(OpContext *ctx) {
     mock.begin_op(ctx);
 }
 
+static void stub_begin_op_sized(OpContext *ctx, usize) {
+    mock.begin_op(ctx);
+}
+
+static void stub_begin_read_op(OpContext *ctx) {
+    mock.begin_op(ctx);
+}
+
+static void stub_upgrade_op(OpContext *) {}
+
 static void stub_end_op(OpContext *ctx) {
     mock.end_op(ctx);
 }
@@ -18,32 +28,74 @@ static usize stub_alloc(OpContext *ctx) {
     return mock.alloc(ctx);
 }
 
+static usize stub_alloc_near(OpContext *ctx, usize goal) {
+    return mock.alloc_near(ctx, goal);
+}
+
+static usize stub_alloc_data(OpContext *ctx, usize goal) {
+    return mock.alloc_near(ctx, goal);
+}
+
 static void stub_free(OpContext *ctx, usize block_no) {
     mock.free(ctx, block_no);
 }
 
+static void stub_free_run(OpContext *ctx, usize block_no, usize num_blocks) {
+    for (usize i = 0; i < num_blocks; i++) {
+        mock.free(ctx, block_no + i);
+    }
+}
+
 static Block *stub_acquire(usize block_no) {
     return mock.acquire(block_no);
 }
 
+static Block *stub_acquire_new(usize block_no) {
+    auto *b = mock.acquire(block_no);
+    std::fill(b->data, b->data + BLOCK_SIZE, 0);
+    return b;
+}
+
 static void stub_release(Block *block) {
     return mock.release(block);
 }
 
+static void stub_prefetch(usize block_no) {
+    mock.prefetch(block_no);
+}
+
 static void stub_sync(OpContext *ctx, Block *block) {
     mock.sync(ctx, block);
 }
 
+static void stub_sync_range(OpContext *ctx, Block *block, usize, usize) {
+    mock.sync(ctx, block);
+}
+
+static void stub_sync_data(OpContext *ctx, Block *block) {
+    mock.sync(ctx, block);
+}
+
 static struct _Loader {
     _Loader() {
         sblock = mock.get_sblock();
 
         cache.begin_op = stub_begin_op;
+        cache.begin_op_sized = stub_begin_op_sized;
+        cache.begin_read_op = stub_begin_read_op;
+        cache.upgrade_op = stub_upgrade_op;
         cache.end_op = stub_end_op;
         cache.alloc = stub_alloc;
+        cache.alloc_near = stub_alloc_near;
+        cache.alloc_data = stub_alloc_data;
         cache.free = stub_free;
+        cache.free_run = stub_free_run;
         cache.acquire = stub_acquire;
+        cache.acquire_new = stub_acquire_new;
         cache.release = stub_release;
+        cache.prefetch = stub_prefetch;
         cache.sync = stub_sync;
+        cache.sync_range = stub_sync_range;
+        cache.sync_data = stub_sync_data;
     }
 } _loader;
@@ -14,6 +14,13 @@ struct Mutex {
         locked = true;
     }
 
+    bool try_lock() {
+        if (!mutex.try_lock())
+            return false;
+        locked = true;
+        return true;
+    }
+
     void unlock() {
         locked = false;
         mutex.unlock();
@@ -43,6 +50,10 @@ void acquire_spinlock(struct SpinLock *lock) {
     mtx_map[lock].lock();
 }
 
+bool try_acquire_spinlock(struct SpinLock *lock) {
+    return mtx_map[lock].try_lock();
+}
+
 void release_spinlock(struct SpinLock *lock) {
     mtx_map[lock].unlock();
 }
@@ -0,0 +1,27 @@
+#include "memory.hpp"
+
+#include <algorithm>
+
+MockMemory mock_memory;
+
+usize MockMemory::reclaim(usize num_pages) {
+    usize num_freed = 0;
+    for (auto hook : hooks) {
+        if (num_freed >= num_pages)
+            break;
+        num_freed += hook(num_pages - num_freed);
+    }
+    return num_freed;
+}
+
+extern "C" {
+usize get_num_free_pages() {
+    return mock_memory.num_free_pages;
+}
+
+void register_reclaim_hook(ReclaimHook hook) {
+    auto &hooks = mock_memory.hooks;
+    if (std::find(hooks.begin(), hooks.end(), hook) == hooks.end())
+        hooks.push_back(hook);
+}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+extern "C" {
+#include <core/physical_memory.h>
+}
+
+#include <vector>
+
+struct MockMemory {
+    // what `get_num_free_pages` returns. The cache does not grow by default.
+    usize num_free_pages = 0;
+    std::vector<ReclaimHook> hooks;
+
+    // run the reclaim hooks as `kalloc` does when it runs out of pages.
+    usize reclaim(usize num_pages);
+};
+
+extern MockMemory mock_memory;
@@ -11,6 +11,7 @@
 #include <driver/clock.h>
 #include <driver/interrupt.h>
 #include <driver/sd.h>
+#include <fs/cache.h>
 #include <fs/fs.h>
 
 struct cpu cpus[NCPU];
@@ -45,6 +46,7 @@ void init_system_once() {
 void hello() {
     // printf("CPU %d: HELLO!\n", cpuid());
     reset_clock(1000);
+    bcache_tick();
     yield();
 }
 
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../../core/syscallno.h"
+#include "../../fs/stats.h"
+
+// print the non-empty buckets of a histogram of `CacheStats`.
+static void print_histogram(const char *title, const char *unit, const usize *buckets) {
+    printf("%s:\n", title);
+    for (int i = 0; i < CACHE_STATS_NUM_BUCKETS; i++) {
+        if (buckets[i] == 0)
+            continue;
+        if (i == 0)
+            printf("  %16s %s: %llu\n", "0", unit, buckets[i]);
+        else if (i == CACHE_STATS_NUM_BUCKETS - 1)
+            printf("  %6s %9llu %s: %llu\n", ">=", 1ull << (i - 1), unit, buckets[i]);
+        else
+            printf("  %6llu-%-9llu %s: %llu\n", 1ull << (i - 1), (1ull << i) - 1, unit, buckets[i]);
+    }
+}
+
+int main() {
+    CacheStats st;
+    if (syscall(SYS_cachestat, &st) < 0) {
+        fprintf(stderr, "cachestat: cannot read cache statistics\n");
+        return 1;
+    }
+
+    usize num_acquires = st.num_hits + st.num_misses;
+    printf("cache: %llu/%llu blocks, %llu pinned, %llu dirty\n",
+           st.num_cached,
+           st.capacity,
+           st.num_pinned,
+           st.num_dirty);
+    printf("  %llu hits, %llu misses (%llu%% hit), %llu evictions\n",
+           st.num_hits,
+           st.num_misses,
+           num_acquires ? st.num_hits * 100 / num_acquires : 0,
+           st.num_evictions);
+    printf("log: %llu/%llu blocks reserved\n", st.num_reserved, st.log_size);
+    printf("  %llu operations, %llu waited for %llu us in total\n",
+           st.num_ops,
+           st.num_waits,
+           st.wait_time);
+    printf("  %llu commits, %llu log writes, %llu data writes\n",
+           st.log.num_commits,
+           st.log.num_log_writes,
+           st.log.num_data_writes);
+    printf("  %llu checkpoints, %llu home writes\n",
+           st.log.num_checkpoints,
+           st.log.num_home_writes);
+    print_histogram("commit size", "blocks", st.commit_size);
+    print_histogram("commit time", "us", st.commit_time);
+    return 0;
+}
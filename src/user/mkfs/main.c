@@ -32,9 +32,9 @@ typedef uint32_t uint;
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
 #define BSIZE BLOCK_SIZE
-#define LOGSIZE LOG_MAX_SIZE
-#define NDIRECT INODE_NUM_DIRECT
-#define NINDIRECT INODE_NUM_INDIRECT
+#define LOGTXN  127  // log blocks of the largest transaction.
+#define LOGSIZE (1 + LOG_NUM_DESCRIPTORS(LOGTXN) + LOGTXN)
+#define NEXTENTS INODE_NUM_EXTENTS
 #define DIRSIZ FILE_NAME_MAX_LENGTH
 #define IPB (BSIZE / sizeof(InodeEntry))
 #define IBLOCK(i, sb) ((i) / IPB + sb.inode_start)
@@ -269,30 +269,33 @@ void iappend(uint inum, void* xp, int n) {
     uint fbn, off, n1;
     struct dinode din;
     char buf[BSIZE];
-    uint indirect[NINDIRECT];
-    uint x;
+    Extent* e;
+    uint x, nx;
 
     rinode(inum, &din);
     off = xint(din.num_bytes);
     // printf("append inum %d at off %d sz %d\n", inum, off, n);
     while (n > 0) {
         fbn = off / BSIZE;
-        assert(fbn < INODE_MAX_BLOCKS);
-        if (fbn < NDIRECT) {
-            if (xint(din.addrs[fbn]) == 0) {
-                din.addrs[fbn] = xint(freeblock++);
-            }
-            x = xint(din.addrs[fbn]);
+        // files are only appended to, so `fbn` is in the last extent or right
+        // after it. Only the extents in the inode are used.
+        assert(xshort(din.depth) == 0);
+        nx = xshort(din.num_extents);
+        e = nx > 0 ? &din.extents[nx - 1] : 0;
+        if (e && fbn < xint(e->start) + xint(e->num_blocks)) {
+            x = xint(e->block_no) + fbn - xint(e->start);
         } else {
-            if (xint(din.indirect) == 0) {
-                din.indirect = xint(freeblock++);
-            }
-            rsect(xint(din.indirect), (char*)indirect);
-            if (indirect[fbn - NDIRECT] == 0) {
-                indirect[fbn - NDIRECT] = xint(freeblock++);
-                wsect(xint(din.indirect), (char*)indirect);
+            x = freeblock++;
+            if (e && xint(e->block_no) + xint(e->num_blocks) == x) {
+                e->num_blocks = xint(xint(e->num_blocks) + 1);
+            } else {
+                assert(nx < NEXTENTS);
+                e = &din.extents[nx];
+                e->start = xint(fbn);
+                e->block_no = xint(x);
+                e->num_blocks = xint(1);
+                din.num_extents = xshort(nx + 1);
             }
-            x = xint(indirect[fbn - NDIRECT]);
         }
         n1 = min(n, (fbn + 1) * BSIZE - off);
         rsect(x, buf);